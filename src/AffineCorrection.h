@@ -0,0 +1,106 @@
+// File: AffineCorrection.h
+// Author: David Antaki
+// Date: 10/18/2026
+// License: Closed source
+//
+// Contents: Per-unit correction of one shared master table. Units of the
+// same sensor model differ mostly by a mounting offset and scale of the
+// distance and by the gain and offset of their flux reading, so instead of
+// a full table per unit every unit stores 16 bytes:
+//
+//   y_unit(x) = outGain * f(inGain * x + inOffset) + outOffset
+//
+// with f the master table. The terms come from a two-point or few-point
+// calibration of the unit: fitOutput() fits the output terms and
+// fitInput() the input terms, each by linear least squares against the
+// master table. The correction is applied inside the batch kernels, see
+// FunctionToPiecewise::xToyBatch().
+
+#ifndef AFFINE_CORRECTION_H
+#define AFFINE_CORRECTION_H
+
+#include <cmath>
+#include "mbed.h"
+
+class AffineCorrection
+{
+public:
+    float inGain;
+    float inOffset;
+    float outGain;
+    float outOffset;
+
+    // @return  The correction that changes nothing
+    static AffineCorrection identity();
+
+    // Fits the output terms, outGain * masterY + outOffset = measuredY,
+    // and leaves the input terms at identity. Two points are enough.
+    //
+    // @param _masterY      The master table's y at the calibration points
+    // @param _measuredY    The unit's measured y at the same points
+    // @param _n            The number of calibration points, at least 2
+    // @return              The correction
+    static AffineCorrection fitOutput(const float *_masterY, const float *_measuredY, size_t _n);
+
+    // Fits the input terms, inGain * x + inOffset = masterX, and leaves
+    // the output terms at identity. Two points are enough.
+    //
+    // @param _x            The calibration distances
+    // @param _masterX      The master table's x for the unit's measured y
+    //                      at the calibration points, i.e. yTox()
+    // @param _n            The number of calibration points, at least 2
+    // @return              The correction
+    static AffineCorrection fitInput(const float *_x, const float *_masterX, size_t _n);
+
+private:
+    // Fits b = gain * a + offset by least squares
+    static void fitLine(const float *_a, const float *_b, size_t _n, float &_gain, float &_offset);
+};
+
+AffineCorrection AffineCorrection::identity()
+{
+    AffineCorrection correction = {1, 0, 1, 0};
+    return correction;
+}
+
+AffineCorrection AffineCorrection::fitOutput(const float *_masterY, const float *_measuredY, size_t _n)
+{
+    AffineCorrection correction = identity();
+    fitLine(_masterY, _measuredY, _n, correction.outGain, correction.outOffset);
+    return correction;
+}
+
+AffineCorrection AffineCorrection::fitInput(const float *_x, const float *_masterX, size_t _n)
+{
+    AffineCorrection correction = identity();
+    fitLine(_x, _masterX, _n, correction.inGain, correction.inOffset);
+    return correction;
+}
+
+void AffineCorrection::fitLine(const float *_a, const float *_b, size_t _n, float &_gain, float &_offset)
+{
+    double n = _n, sa = 0, sb = 0, saa = 0, sab = 0;
+    for (size_t i = 0; i < _n; i++)
+    {
+        sa += _a[i];
+        sb += _b[i];
+        saa += (double)_a[i] * _a[i];
+        sab += (double)_a[i] * _b[i];
+    }
+
+    double denominator = n * saa - sa * sa;
+    if (_n < 2 || !(fabs(denominator) > 1e-12 * n * saa))
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "A calibration needs at least 2 distinct points");
+    }
+
+    _gain = (float)((n * sab - sa * sb) / denominator);
+    _offset = (float)((sb - _gain * sa) / n);
+
+    if (_gain == 0)
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "A calibration gain of 0 cannot be inverted");
+    }
+}
+
+#endif //AFFINE_CORRECTION_H
@@ -0,0 +1,202 @@
+// File: BatchLookup.h
+// Author: David Antaki
+// Date: 10/18/2026
+// License: Closed source
+//
+// Contents: Batch kernel behind FunctionToPiecewise::xToyBatch() and
+// yToxBatch(). For tables much larger than the cache every step of a
+// binary search waits on memory. Here the queries are processed in groups
+// and the search steps of a group are interleaved: after one step of a
+// query the memory of its next step is prefetched, and the other queries
+// of the group are worked on while it arrives (group prefetching). Every
+// search has the same number of steps, so the group stays in lockstep
+// without branches.
+
+#ifndef BATCH_LOOKUP_H
+#define BATCH_LOOKUP_H
+
+#include <stddef.h>
+#include "mbed.h"
+
+// Floating point contraction (fusing a * b + c into one FMA, which rounds
+// once instead of twice) is turned off for all code between these, in
+// this file and in KernelDispatch.h, FunctionToPiecewise.h and
+// LearnedIndexPiecewise.h. So the scalar lookups and every kernel variant
+// round the same way, whatever ISA the host or the -march baseline has.
+#if defined(__clang__)
+#define PIECEWISE_NO_CONTRACT_BEGIN _Pragma("float_control(push)") _Pragma("clang fp contract(off)")
+#define PIECEWISE_NO_CONTRACT_END _Pragma("float_control(pop)")
+#elif defined(__GNUC__)
+#define PIECEWISE_NO_CONTRACT_BEGIN _Pragma("GCC push_options") _Pragma("GCC optimize(\"fp-contract=off\")")
+#define PIECEWISE_NO_CONTRACT_END _Pragma("GCC pop_options")
+#else
+#define PIECEWISE_NO_CONTRACT_BEGIN
+#define PIECEWISE_NO_CONTRACT_END
+#endif
+
+#if defined(__GNUC__)
+#define BATCH_LOOKUP_PREFETCH(address) __builtin_prefetch(address)
+// Forced inline so every ISA variant in KernelDispatch.h gets its own copy
+#define BATCH_LOOKUP_INLINE inline __attribute__((always_inline))
+#else
+#define BATCH_LOOKUP_PREFETCH(address)
+#define BATCH_LOOKUP_INLINE inline
+#endif
+
+PIECEWISE_NO_CONTRACT_BEGIN
+
+class BatchLookup
+{
+public:
+    // The number of queries that are interleaved
+    static const size_t GROUP_SIZE = 16;
+
+    // Finds the segment of every input and evaluates it.
+    //
+    // @param _breaks       _nSegments + 1 segment boundaries. _sign * _breaks
+    //                      must be ascending.
+    // @param _segments     _nSegments segments with .slope and .yint
+    // @param _nSegments    The number of segments
+    // @param _sign         1 or -1, see _breaks
+    // @param _in           Array of _n inputs
+    // @param _out          Array that receives the _n outputs
+    // @param _n            The number of inputs
+    template <class Segment>
+    static BATCH_LOOKUP_INLINE void run(const float *_breaks, const Segment *_segments, size_t _nSegments, float _sign,
+                                        const float *_in, float *_out, size_t _n);
+
+    // Same as run(), with an affine transform fused before and after the
+    // lookup: out = _postGain * f(_preGain * in + _preOffset) + _postOffset
+    // (see AffineCorrection.h). The transformed input must be in range.
+    // The inputs and outputs are _inStride and _outStride bytes apart (see
+    // StridedView.h) and may be fields of the same structs. If _slopes is
+    // not nullptr it receives the _n derivatives d out / d in, i.e.
+    // _postGain * slope * _preGain of every input's segment.
+    template <class Segment>
+    static BATCH_LOOKUP_INLINE void runAffine(const float *_breaks, const Segment *_segments, size_t _nSegments, float _sign,
+                                              float _preGain, float _preOffset, float _postGain, float _postOffset,
+                                              const float *_in, size_t _inStride, float *_out, size_t _outStride, size_t _n,
+                                              float *_slopes);
+
+    // Computes the f(x) and f(y) line functions of every segment from the
+    // knots, the build kernel of the flat segment arrays.
+    //
+    // @param _knotXs       _nSegments + 1 knot x-values
+    // @param _knotYs       _nSegments + 1 knot y-values
+    // @param _xSegments    Receives the _nSegments f(x) functions
+    // @param _ySegments    Receives the _nSegments f(y) functions
+    // @param _nSegments    The number of segments
+    template <class Segment>
+    static BATCH_LOOKUP_INLINE void buildSegments(const float *_knotXs, const float *_knotYs,
+                                                  Segment *_xSegments, Segment *_ySegments, size_t _nSegments);
+};
+
+const size_t BatchLookup::GROUP_SIZE;
+
+template <class Segment>
+BATCH_LOOKUP_INLINE void BatchLookup::run(const float *_breaks, const Segment *_segments, size_t _nSegments, float _sign,
+                                          const float *_in, float *_out, size_t _n)
+{
+    // The identity transform is exact, so this returns the plain lookup
+    runAffine(_breaks, _segments, _nSegments, _sign, 1, 0, 1, 0, _in, sizeof(float), _out, sizeof(float), _n, (float *)nullptr);
+}
+
+template <class Segment>
+BATCH_LOOKUP_INLINE void BatchLookup::runAffine(const float *_breaks, const Segment *_segments, size_t _nSegments, float _sign,
+                                                float _preGain, float _preOffset, float _postGain, float _postOffset,
+                                                const float *_in, size_t _inStride, float *_out, size_t _outStride, size_t _n,
+                                                float *_slopes)
+{
+    float first = _sign * _breaks[0];
+    float last = _sign * _breaks[_nSegments];
+
+    for (size_t begin = 0; begin < _n; begin += GROUP_SIZE)
+    {
+        size_t groupSize = (_n - begin < GROUP_SIZE) ? _n - begin : GROUP_SIZE;
+        float inputs[GROUP_SIZE];
+        float keys[GROUP_SIZE];
+        size_t base[GROUP_SIZE];
+
+        for (size_t g = 0; g < groupSize; g++)
+        {
+            const float &in = *(const float *)((const char *)_in + (begin + g) * _inStride);
+            inputs[g] = (_preGain * in) + _preOffset;
+            keys[g] = _sign * inputs[g];
+            base[g] = 0;
+
+            if (!(keys[g] >= first && keys[g] <= last))
+            {
+                MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "Batch input is out of the piecewise function's interval");
+            }
+        }
+
+        // Branchless binary search for the last break <= key among the
+        // first _nSegments breaks, one step for the whole group at a time
+        size_t length = _nSegments;
+        if (length > 1)
+            BATCH_LOOKUP_PREFETCH(&_breaks[length / 2]);
+
+        while (length > 1)
+        {
+            size_t half = length / 2;
+            size_t nextHalf = (length - half) / 2;
+
+            for (size_t g = 0; g < groupSize; g++)
+            {
+                base[g] = (_sign * _breaks[base[g] + half] <= keys[g]) ? base[g] + half : base[g];
+
+                // The break the next step of this query will read
+                BATCH_LOOKUP_PREFETCH(&_breaks[base[g] + nextHalf]);
+            }
+
+            length -= half;
+        }
+
+        for (size_t g = 0; g < groupSize; g++)
+            BATCH_LOOKUP_PREFETCH(&_segments[base[g]]);
+
+        for (size_t g = 0; g < groupSize; g++)
+        {
+            const Segment &segment = _segments[base[g]];
+            float &out = *(float *)((char *)_out + (begin + g) * _outStride);
+            out = (_postGain * ((segment.slope * inputs[g]) + segment.yint)) + _postOffset;
+        }
+
+        if (_slopes != nullptr)
+        {
+            for (size_t g = 0; g < groupSize; g++)
+                _slopes[begin + g] = _postGain * _segments[base[g]].slope * _preGain;
+        }
+    }
+}
+
+template <class Segment>
+BATCH_LOOKUP_INLINE void BatchLookup::buildSegments(const float *_knotXs, const float *_knotYs,
+                                                    Segment *_xSegments, Segment *_ySegments, size_t _nSegments)
+{
+    for (size_t i = 0; i < _nSegments; i++)
+    {
+        float slope = (_knotYs[i + 1] - _knotYs[i]) / (_knotXs[i + 1] - _knotXs[i]);
+        float yint = _knotYs[i] - (slope * _knotXs[i]);
+
+        _xSegments[i].slope = slope;
+        _xSegments[i].yint = yint;
+
+        // y=mx+b --> x=(y/m)-(b/m). A flat segment has no inverse, it
+        // returns its left knot, which does map to the segment's y.
+        if (slope != 0)
+        {
+            _ySegments[i].slope = 1 / slope;
+            _ySegments[i].yint = (-1 * yint) / slope;
+        }
+        else
+        {
+            _ySegments[i].slope = 0;
+            _ySegments[i].yint = _knotXs[i];
+        }
+    }
+}
+
+PIECEWISE_NO_CONTRACT_END
+
+#endif //BATCH_LOOKUP_H
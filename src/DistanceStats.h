@@ -0,0 +1,208 @@
+// File: DistanceStats.h
+// Author: David Antaki
+// Date: 10/18/2026
+// License: Closed source
+//
+// Contents: Reducers that aggregate converted x values (e.g. distances)
+// one at a time so they can be fused with FunctionToPiecewise::yToxReduce().
+// Long logs of raw readings can then be summarized without ever writing
+// the converted values to memory.
+//
+// Example:
+//      MinMaxMeanReducer stats;
+//      piecewise.yToxReduce(fluxLog, nSamples, stats);
+//      stats.mean();
+
+#ifndef DISTANCE_STATS_H
+#define DISTANCE_STATS_H
+
+#include <vector>
+#include <cmath>
+#include "mbed.h"
+
+// Keeps the minimum, maximum and mean of all values
+class MinMaxMeanReducer
+{
+public:
+    MinMaxMeanReducer();
+
+    void add(float _x);
+
+    size_t count() const;
+    float min() const;
+    float max() const;
+    float mean() const;
+
+private:
+    size_t n;
+    float minimum;
+    float maximum;
+    double sum;
+};
+
+// Counts values in evenly sized bins. Values outside of the histogram's
+// interval are counted in the first or last bin, NaN in the first.
+class HistogramReducer
+{
+public:
+    // @param _nBins        The number of bins
+    // @param _interval     The interval covered by the bins
+    HistogramReducer(int _nBins, std::pair<float, float> _interval);
+
+    void add(float _x);
+
+    // @return  The number of values in every bin
+    const std::vector<size_t> &getBins() const;
+
+private:
+    std::pair<float, float> interval;
+    float binsPerUnit;
+    std::vector<size_t> bins;
+};
+
+// Measures how long the values stay above a threshold, assuming they are
+// evenly spaced in time.
+class TimeAboveThresholdReducer
+{
+public:
+    // @param _threshold        The threshold, e.g. a distance in mm
+    // @param _samplePeriod     The time between two values, e.g. in s
+    TimeAboveThresholdReducer(float _threshold, float _samplePeriod);
+
+    void add(float _x);
+
+    // @return  The total time spent above the threshold
+    float timeAbove() const;
+
+    // @return  The number of times the values crossed the threshold upwards
+    size_t crossings() const;
+
+private:
+    float threshold;
+    float samplePeriod;
+    size_t nAbove;
+    size_t nCrossings;
+    bool wasAbove;
+};
+
+// Feeds every value to two reducers so several statistics are gathered in
+// one pass. Can be nested for more than two.
+template <class First, class Second>
+class CombinedReducer
+{
+public:
+    CombinedReducer(First &_first, Second &_second) : first(_first), second(_second) {}
+
+    void add(float _x)
+    {
+        first.add(_x);
+        second.add(_x);
+    }
+
+private:
+    First &first;
+    Second &second;
+};
+
+MinMaxMeanReducer::MinMaxMeanReducer()
+{
+    n = 0;
+    minimum = INFINITY;
+    maximum = -INFINITY;
+    sum = 0;
+}
+
+void MinMaxMeanReducer::add(float _x)
+{
+    n++;
+    minimum = (_x < minimum) ? _x : minimum;
+    maximum = (_x > maximum) ? _x : maximum;
+    sum += _x;
+}
+
+size_t MinMaxMeanReducer::count() const
+{
+    return n;
+}
+
+float MinMaxMeanReducer::min() const
+{
+    return minimum;
+}
+
+float MinMaxMeanReducer::max() const
+{
+    return maximum;
+}
+
+float MinMaxMeanReducer::mean() const
+{
+    return (n > 0) ? (float)(sum / n) : NAN;
+}
+
+HistogramReducer::HistogramReducer(int _nBins, std::pair<float, float> _interval)
+{
+    if (_nBins < 1 || !(_interval.second > _interval.first))
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "Invalid number of bins or interval for the histogram");
+    }
+
+    interval = _interval;
+    binsPerUnit = _nBins / (_interval.second - _interval.first);
+    bins.assign(_nBins, 0);
+}
+
+void HistogramReducer::add(float _x)
+{
+    // Clamp before converting, casting NaN or a float out of the range of
+    // int is undefined
+    float position = (_x - interval.first) * binsPerUnit;
+    size_t bin;
+
+    if (!(position >= 0))
+        bin = 0;
+    else if (position >= (float)bins.size())
+        bin = bins.size() - 1;
+    else
+        bin = (size_t)position;
+
+    bins[bin]++;
+}
+
+const std::vector<size_t> &HistogramReducer::getBins() const
+{
+    return bins;
+}
+
+TimeAboveThresholdReducer::TimeAboveThresholdReducer(float _threshold, float _samplePeriod)
+{
+    threshold = _threshold;
+    samplePeriod = _samplePeriod;
+    nAbove = 0;
+    nCrossings = 0;
+    wasAbove = false;
+}
+
+void TimeAboveThresholdReducer::add(float _x)
+{
+    bool above = _x > threshold;
+
+    if (above && !wasAbove)
+        nCrossings++;
+    if (above)
+        nAbove++;
+
+    wasAbove = above;
+}
+
+float TimeAboveThresholdReducer::timeAbove() const
+{
+    return nAbove * samplePeriod;
+}
+
+size_t TimeAboveThresholdReducer::crossings() const
+{
+    return nCrossings;
+}
+
+#endif //DISTANCE_STATS_H
@@ -0,0 +1,663 @@
+// File: Expression.h
+// Author: David Antaki
+// Date: 10/18/2026
+// License: Closed source
+//
+// Contents: Compiles a function given as text at runtime, e.g. read from a
+// config file, so new sensor curves do not need a new firmware build. The
+// text is parsed once into a small stack-machine bytecode. evalBatch() runs
+// every instruction over a block of inputs at a time, so the inner loops
+// are plain array loops the compiler can vectorize, and tabulate() feeds
+// the result straight into a FunctionToPiecewise. The evaluation stack is a
+// fixed block on the C stack, so evaluating never allocates and any number
+// of threads may evaluate one Expression at once, as long as none of them
+// calls setParameter() meanwhile.
+//
+// Syntax: numbers, the variable (x by default), named parameters, pi, e,
+// + - * / ^ (power), parentheses and the functions sin, cos, tan, asin,
+// acos, atan, atan2(a, b), sqrt, pow(a, b), exp, log and abs.
+//
+// Example (Func2 from test.cpp with the magnet dimensions as parameters):
+//      (br / pi) * (atan(w*l / (2*x*sqrt(4*x^2 + w^2 + l^2)))
+//                 - atan(w*l / (2*(x+t)*sqrt(4*(x+t)^2 + w^2 + l^2))))
+
+#ifndef EXPRESSION_H
+#define EXPRESSION_H
+
+#include <vector>
+#include <string>
+#include <map>
+#include <cmath>
+#include <cstdlib>
+#include <cctype>
+#include <cstdio>
+#include <stdint.h>
+#include "mbed.h"
+#include "FunctionToPiecewise.h"
+
+class Expression
+{
+public:
+    // @param _source       The text of the expression
+    // @param _parameters   Named parameters and their initial values
+    // @param _variable     The name of the variable
+    Expression(const std::string &_source,
+               const std::map<std::string, float> &_parameters = std::map<std::string, float>(),
+               const std::string &_variable = "x");
+
+    // Changes a parameter without recompiling
+    //
+    // @param _name     The name of the parameter
+    // @param _value    The new value
+    void setParameter(const std::string &_name, float _value);
+
+    // Evaluates the expression for one value of the variable
+    //
+    // @param _x    The value of the variable
+    // @return      The value of the expression
+    float eval(float _x) const;
+
+    // Evaluates the expression for _n values of the variable
+    //
+    // @param _x    Array of _n values of the variable
+    // @param _y    Array that receives the _n results
+    // @param _n    The number of values
+    void evalBatch(const float *_x, float *_y, size_t _n) const;
+
+    // Builds a piecewise function of the expression with _nSegments evenly
+    // spaced segments. Unlike the FunctionToPiecewise constructor, which
+    // adds up the increment, every knot is computed from its index, so
+    // there are exactly _nSegments segments and the last knot is the end
+    // of the interval.
+    //
+    // @param _nSegments    The number of segments
+    // @param _interval     The interval of the piecewise function
+    // @return              The piecewise function
+    FunctionToPiecewise tabulate(int _nSegments, std::pair<float, float> _interval) const;
+
+private:
+    enum OpCode
+    {
+        PUSH_CONST,
+        PUSH_VARIABLE,
+        PUSH_PARAMETER,
+        ADD,
+        SUBTRACT,
+        MULTIPLY,
+        DIVIDE,
+        POWER,
+        NEGATE,
+        SIN,
+        COS,
+        TAN,
+        ASIN,
+        ACOS,
+        ATAN,
+        ATAN2,
+        SQRT,
+        EXP,
+        LOG,
+        ABS
+    };
+
+    typedef struct
+    {
+        uint8_t op;
+        // The constant of PUSH_CONST or the index of PUSH_PARAMETER
+        float value;
+    } Instruction;
+
+    // The most inputs evalBatch() runs every instruction over
+    static const size_t BLOCK_SIZE = 64;
+
+    // Floats of the evaluation stack on the C stack, shared by all stack
+    // entries. Deep expressions run fewer inputs at a time to fit.
+    static const size_t SCRATCH_SIZE = 256;
+
+    std::vector<Instruction> program;
+    std::vector<std::string> parameterNames;
+    std::vector<float> parameterValues;
+    std::string variable;
+
+    // The deepest the stack gets while running the program
+    int maxStackDepth;
+
+    // The number of inputs every pass of evalBatch() runs, so that
+    // maxStackDepth entries of them fit in SCRATCH_SIZE floats
+    size_t blockSize;
+
+    // Parser state, only used while compiling
+    std::string source;
+    size_t pos;
+    int stackDepth;
+
+    // Recursive descent parser, one function per precedence level
+    void parseSum();
+    void parseProduct();
+    void parseUnary();
+    void parsePower();
+    void parsePrimary();
+
+    // Appends an instruction and tracks the stack depth
+    //
+    // @param _op       The op code
+    // @param _value    The constant or parameter index
+    // @param _pops     How many values the instruction pops
+    void emit(OpCode _op, float _value, int _pops);
+
+    void skipSpaces();
+
+    // @return  True and consumes _c if it is the next character
+    bool accept(char _c);
+
+    // Stops with an error if _c is not the next character
+    void expect(char _c);
+
+    // Parses a decimal number with optional fraction and exponent. Unlike
+    // strtof() it always uses '.' as the decimal point, whatever the
+    // locale.
+    //
+    // @return  The number
+    float parseNumber();
+
+    // Stops with an error that points at the current position
+    void fail(const char *_message);
+
+    // Runs one instruction over _n stack slots. The i'th stack entry of
+    // all _n inputs starts at _stack + i * blockSize.
+    void execute(const Instruction &_instruction, float *_stack, int &_top,
+                 const float *_x, size_t _n) const;
+};
+
+const size_t Expression::BLOCK_SIZE;
+const size_t Expression::SCRATCH_SIZE;
+
+Expression::Expression(const std::string &_source, const std::map<std::string, float> &_parameters,
+                       const std::string &_variable)
+{
+    variable = _variable;
+    for (auto iter = _parameters.cbegin(); iter != _parameters.cend(); iter++)
+    {
+        parameterNames.push_back(iter->first);
+        parameterValues.push_back(iter->second);
+    }
+
+    source = _source;
+    pos = 0;
+    stackDepth = 0;
+    maxStackDepth = 0;
+
+    parseSum();
+    skipSpaces();
+    if (pos != source.size())
+        fail("Unexpected character in expression");
+
+    // Release the parser state
+    source.clear();
+
+    blockSize = std::min(BLOCK_SIZE, SCRATCH_SIZE / maxStackDepth);
+}
+
+void Expression::setParameter(const std::string &_name, float _value)
+{
+    for (size_t i = 0; i < parameterNames.size(); i++)
+    {
+        if (parameterNames[i] == _name)
+        {
+            parameterValues[i] = _value;
+            return;
+        }
+    }
+
+    MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "Unknown expression parameter");
+}
+
+float Expression::eval(float _x) const
+{
+    float y;
+    evalBatch(&_x, &y, 1);
+    return y;
+}
+
+void Expression::evalBatch(const float *_x, float *_y, size_t _n) const
+{
+    float stack[SCRATCH_SIZE];
+
+    for (size_t begin = 0; begin < _n; begin += blockSize)
+    {
+        size_t n = std::min(blockSize, _n - begin);
+        int top = -1;
+
+        for (size_t i = 0; i < program.size(); i++)
+        {
+            execute(program[i], stack, top, _x + begin, n);
+        }
+
+        for (size_t j = 0; j < n; j++)
+        {
+            _y[begin + j] = stack[j];
+        }
+    }
+}
+
+FunctionToPiecewise Expression::tabulate(int _nSegments, std::pair<float, float> _interval) const
+{
+    if (_nSegments < 1 || !(_interval.second > _interval.first))
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "Invalid number of segments or interval");
+    }
+
+    std::vector<float> xs(_nSegments + 1);
+    std::vector<float> ys(_nSegments + 1);
+    for (int k = 0; k <= _nSegments; k++)
+    {
+        xs[k] = _interval.first + (_interval.second - _interval.first) * ((float)k / _nSegments);
+    }
+    xs[_nSegments] = _interval.second;
+
+    evalBatch(xs.data(), ys.data(), xs.size());
+
+    std::vector<FunctionToPiecewise::Point> knots(_nSegments + 1);
+    for (int k = 0; k <= _nSegments; k++)
+    {
+        knots[k].x = xs[k];
+        knots[k].y = ys[k];
+    }
+
+    return FunctionToPiecewise(knots);
+}
+
+void Expression::parseSum()
+{
+    parseProduct();
+
+    while (true)
+    {
+        if (accept('+'))
+        {
+            parseProduct();
+            emit(ADD, 0, 2);
+        }
+        else if (accept('-'))
+        {
+            parseProduct();
+            emit(SUBTRACT, 0, 2);
+        }
+        else
+        {
+            return;
+        }
+    }
+}
+
+void Expression::parseProduct()
+{
+    parseUnary();
+
+    while (true)
+    {
+        if (accept('*'))
+        {
+            parseUnary();
+            emit(MULTIPLY, 0, 2);
+        }
+        else if (accept('/'))
+        {
+            parseUnary();
+            emit(DIVIDE, 0, 2);
+        }
+        else
+        {
+            return;
+        }
+    }
+}
+
+void Expression::parseUnary()
+{
+    if (accept('-'))
+    {
+        parseUnary();
+        emit(NEGATE, 0, 1);
+    }
+    else if (accept('+'))
+    {
+        parseUnary();
+    }
+    else
+    {
+        parsePower();
+    }
+}
+
+void Expression::parsePower()
+{
+    parsePrimary();
+
+    // Right associative, and binds tighter than unary minus on its left:
+    // -x^2 = -(x^2)
+    if (accept('^'))
+    {
+        parseUnary();
+        emit(POWER, 0, 2);
+    }
+}
+
+void Expression::parsePrimary()
+{
+    skipSpaces();
+
+    if (accept('('))
+    {
+        parseSum();
+        expect(')');
+        return;
+    }
+
+    if (pos < source.size() && (isdigit(source[pos]) || source[pos] == '.'))
+    {
+        emit(PUSH_CONST, parseNumber(), 0);
+        return;
+    }
+
+    size_t start = pos;
+    while (pos < source.size() && (isalnum(source[pos]) || source[pos] == '_'))
+        pos++;
+
+    if (start == pos)
+        fail("Expected a number, name or '(' in expression");
+
+    std::string name = source.substr(start, pos - start);
+
+    if (accept('('))
+    {
+        static const struct
+        {
+            const char *name;
+            OpCode op;
+            int nArguments;
+        } functions[] = {
+            {"sin", SIN, 1}, {"cos", COS, 1}, {"tan", TAN, 1}, {"asin", ASIN, 1},
+            {"acos", ACOS, 1}, {"atan", ATAN, 1}, {"atan2", ATAN2, 2}, {"sqrt", SQRT, 1},
+            {"pow", POWER, 2}, {"exp", EXP, 1}, {"log", LOG, 1}, {"abs", ABS, 1}};
+
+        for (size_t i = 0; i < sizeof(functions) / sizeof(functions[0]); i++)
+        {
+            if (name == functions[i].name)
+            {
+                parseSum();
+                for (int a = 1; a < functions[i].nArguments; a++)
+                {
+                    expect(',');
+                    parseSum();
+                }
+                expect(')');
+                emit(functions[i].op, 0, functions[i].nArguments);
+                return;
+            }
+        }
+
+        fail("Unknown function in expression");
+    }
+
+    if (name == variable)
+    {
+        emit(PUSH_VARIABLE, 0, 0);
+        return;
+    }
+
+    for (size_t i = 0; i < parameterNames.size(); i++)
+    {
+        if (name == parameterNames[i])
+        {
+            emit(PUSH_PARAMETER, i, 0);
+            return;
+        }
+    }
+
+    if (name == "pi")
+        emit(PUSH_CONST, M_PI, 0);
+    else if (name == "e")
+        emit(PUSH_CONST, M_E, 0);
+    else
+        fail("Unknown name in expression");
+}
+
+void Expression::emit(OpCode _op, float _value, int _pops)
+{
+    Instruction instruction;
+    instruction.op = _op;
+    instruction.value = _value;
+    program.push_back(instruction);
+
+    // Every instruction pushes exactly one result
+    stackDepth += 1 - _pops;
+    if (stackDepth > maxStackDepth)
+        maxStackDepth = stackDepth;
+
+    if ((size_t)maxStackDepth > SCRATCH_SIZE)
+        fail("Expression is nested too deeply");
+}
+
+void Expression::skipSpaces()
+{
+    while (pos < source.size() && isspace(source[pos]))
+        pos++;
+}
+
+bool Expression::accept(char _c)
+{
+    skipSpaces();
+    if (pos < source.size() && source[pos] == _c)
+    {
+        pos++;
+        return true;
+    }
+    return false;
+}
+
+void Expression::expect(char _c)
+{
+    if (!accept(_c))
+        fail("Missing character in expression");
+}
+
+float Expression::parseNumber()
+{
+    // The significant digits as an integer and the power of 10 to scale
+    // them by. Digits beyond the 17 a double keeps only move the exponent.
+    size_t start = pos;
+    double mantissa = 0;
+    int exponent = 0;
+    int nDigits = 0;
+
+    while (pos < source.size() && isdigit(source[pos]))
+    {
+        if (nDigits < 17)
+        {
+            mantissa = mantissa * 10 + (source[pos] - '0');
+            if (mantissa > 0)
+                nDigits++;
+        }
+        else
+        {
+            exponent++;
+        }
+        pos++;
+    }
+
+    if (pos < source.size() && source[pos] == '.')
+    {
+        pos++;
+        while (pos < source.size() && isdigit(source[pos]))
+        {
+            if (nDigits < 17)
+            {
+                mantissa = mantissa * 10 + (source[pos] - '0');
+                exponent--;
+                if (mantissa > 0)
+                    nDigits++;
+            }
+            pos++;
+        }
+    }
+
+    if (pos == start + 1 && source[start] == '.')
+        fail("Expected digits in number");
+
+    // Only an 'e' followed by digits is an exponent, "2e" is 2 followed
+    // by the constant e
+    if (pos < source.size() && (source[pos] == 'e' || source[pos] == 'E'))
+    {
+        size_t digits = pos + 1;
+        if (digits < source.size() && (source[digits] == '+' || source[digits] == '-'))
+            digits++;
+
+        if (digits < source.size() && isdigit(source[digits]))
+        {
+            int sign = (source[pos + 1] == '-') ? -1 : 1;
+            int written = 0;
+            pos = digits;
+            while (pos < source.size() && isdigit(source[pos]))
+            {
+                if (written < 1000)
+                    written = written * 10 + (source[pos] - '0');
+                pos++;
+            }
+            exponent += sign * written;
+        }
+    }
+
+    // Powers of 10 up to 10^22 are exact in a double, which keeps the
+    // scaling far more precise than a float needs
+    double value = mantissa;
+    while (exponent > 22 && value != 0 && !std::isinf(value))
+    {
+        value *= 1e22;
+        exponent -= 22;
+    }
+    while (exponent < -22 && value != 0)
+    {
+        value /= 1e22;
+        exponent += 22;
+    }
+    if (exponent > 0)
+        value *= pow(10.0, exponent);
+    else if (exponent < 0)
+        value /= pow(10.0, -exponent);
+
+    return (float)value;
+}
+
+void Expression::fail(const char *_message)
+{
+    // MBED_ERROR() reports the message before it halts, so it may live on
+    // the stack
+    char message[160];
+    snprintf(message, sizeof(message), "%s at position %d of \"%s\"", _message, (int)pos, source.c_str());
+    MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), message);
+}
+
+void Expression::execute(const Instruction &_instruction, float *_stack, int &_top,
+                         const float *_x, size_t _n) const
+{
+    // Binary operations combine the two top entries into the lower one
+    float *a = (_top >= 1) ? _stack + (_top - 1) * blockSize : nullptr;
+    float *b = (_top >= 0) ? _stack + _top * blockSize : nullptr;
+
+    switch (_instruction.op)
+    {
+    case PUSH_CONST:
+    case PUSH_PARAMETER:
+    {
+        float value = (_instruction.op == PUSH_CONST) ? _instruction.value : parameterValues[(size_t)_instruction.value];
+        float *out = _stack + (++_top) * blockSize;
+        for (size_t i = 0; i < _n; i++)
+            out[i] = value;
+        break;
+    }
+    case PUSH_VARIABLE:
+    {
+        float *out = _stack + (++_top) * blockSize;
+        for (size_t i = 0; i < _n; i++)
+            out[i] = _x[i];
+        break;
+    }
+    case ADD:
+        for (size_t i = 0; i < _n; i++)
+            a[i] = a[i] + b[i];
+        _top--;
+        break;
+    case SUBTRACT:
+        for (size_t i = 0; i < _n; i++)
+            a[i] = a[i] - b[i];
+        _top--;
+        break;
+    case MULTIPLY:
+        for (size_t i = 0; i < _n; i++)
+            a[i] = a[i] * b[i];
+        _top--;
+        break;
+    case DIVIDE:
+        for (size_t i = 0; i < _n; i++)
+            a[i] = a[i] / b[i];
+        _top--;
+        break;
+    case POWER:
+        for (size_t i = 0; i < _n; i++)
+            a[i] = (b[i] == 2) ? a[i] * a[i] : powf(a[i], b[i]);
+        _top--;
+        break;
+    case ATAN2:
+        for (size_t i = 0; i < _n; i++)
+            a[i] = atan2f(a[i], b[i]);
+        _top--;
+        break;
+    case NEGATE:
+        for (size_t i = 0; i < _n; i++)
+            b[i] = -b[i];
+        break;
+    case SIN:
+        for (size_t i = 0; i < _n; i++)
+            b[i] = sinf(b[i]);
+        break;
+    case COS:
+        for (size_t i = 0; i < _n; i++)
+            b[i] = cosf(b[i]);
+        break;
+    case TAN:
+        for (size_t i = 0; i < _n; i++)
+            b[i] = tanf(b[i]);
+        break;
+    case ASIN:
+        for (size_t i = 0; i < _n; i++)
+            b[i] = asinf(b[i]);
+        break;
+    case ACOS:
+        for (size_t i = 0; i < _n; i++)
+            b[i] = acosf(b[i]);
+        break;
+    case ATAN:
+        for (size_t i = 0; i < _n; i++)
+            b[i] = atanf(b[i]);
+        break;
+    case SQRT:
+        for (size_t i = 0; i < _n; i++)
+            b[i] = sqrtf(b[i]);
+        break;
+    case EXP:
+        for (size_t i = 0; i < _n; i++)
+            b[i] = expf(b[i]);
+        break;
+    case LOG:
+        for (size_t i = 0; i < _n; i++)
+            b[i] = logf(b[i]);
+        break;
+    case ABS:
+        for (size_t i = 0; i < _n; i++)
+            b[i] = fabsf(b[i]);
+        break;
+    }
+}
+
+#endif //EXPRESSION_H
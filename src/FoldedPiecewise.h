@@ -0,0 +1,268 @@
+// File: FoldedPiecewise.h
+// Author: David Antaki
+// Date: 10/18/2026
+// License: Closed source
+//
+// Contents: Piecewise function of a symmetric and/or periodic function
+// that only tabulates its fundamental domain, e.g. one half of an even
+// field profile or one period of an angular sensor response. Inputs are
+// folded into the fundamental domain before the lookup and the output is
+// unfolded again, so the table is 2x (symmetric) or more (periodic)
+// smaller than tabulating the whole interval with the same resolution.
+//
+//  - EVEN about c:   f(2c - x) = f(x)
+//  - ODD about c:    f(2c - x) = 2f(c) - f(x)    (point symmetry)
+//  - period p:       f(x + p) = f(x)
+//
+// With a period and a symmetry, c must be the middle of the period and
+// only the half period [c, start + p] is tabulated. Without a period
+// [c, end] is tabulated, so the mirrored half [start, c] must not be
+// longer. An ODD function must be monotonic on its fundamental domain,
+// otherwise yTox() could not tell which half a y value belongs to.
+
+#ifndef FOLDED_PIECEWISE_H
+#define FOLDED_PIECEWISE_H
+
+#include <vector>
+#include <cmath>
+#include "mbed.h"
+#include "FunctionToPiecewise.h"
+
+class FoldedPiecewise
+{
+public:
+    enum Symmetry
+    {
+        NONE,
+        EVEN,
+        ODD
+    };
+
+    // @param float (*function)(float)  The function to represent
+    // @param _nSegments    The number of segments of the fundamental domain
+    // @param _interval     The interval of the function. With a period
+    //                      only its start is used: the period starts there.
+    // @param _symmetry     The symmetry of the function
+    // @param _center       The center of the symmetry
+    // @param _period       The period of the function, 0 if not periodic
+    FoldedPiecewise(float (*function)(float), int _nSegments, std::pair<float, float> _interval,
+                    Symmetry _symmetry, float _center, float _period = 0);
+
+    // Takes an x value and returns y, like FunctionToPiecewise::xToy()
+    float xToy(float _x);
+
+    // Takes a y value and returns x, like FunctionToPiecewise::yTox().
+    // For EVEN and periodic functions x is not unique; the x in the
+    // fundamental domain is returned.
+    float yTox(float _y);
+
+    // Converts _n x values to y at once, folding them in blocks
+    void xToyBatch(const float *_x, float *_y, size_t _n);
+
+    // @return  The table of the fundamental domain
+    const FunctionToPiecewise &getFundamental() const;
+
+private:
+    Symmetry symmetry;
+    float center;
+    float period;
+    float periodStart;
+
+    // f(center), the center of an ODD function's point symmetry
+    float centerY;
+
+    // The interval that is tabulated
+    std::pair<float, float> fundamental;
+
+    FunctionToPiecewise table;
+
+    // Folds x into the fundamental domain
+    //
+    // @param _x        The x value
+    // @param _mirrored Set to true if x was mirrored about the center
+    // @return          The folded x value
+    float fold(float _x, bool &_mirrored) const;
+
+    // @return  The knots of the fundamental domain
+    static std::vector<FunctionToPiecewise::Point> tabulate(float (*function)(float), int _nSegments,
+                                                            std::pair<float, float> _fundamental);
+
+    // @return  The interval that has to be tabulated
+    static std::pair<float, float> fundamentalDomain(std::pair<float, float> _interval, Symmetry _symmetry,
+                                                     float _center, float _period);
+};
+
+FoldedPiecewise::FoldedPiecewise(float (*function)(float), int _nSegments, std::pair<float, float> _interval,
+                                 Symmetry _symmetry, float _center, float _period)
+    : table(tabulate(function, _nSegments, fundamentalDomain(_interval, _symmetry, _center, _period)))
+{
+    symmetry = _symmetry;
+    center = _center;
+    period = _period;
+    periodStart = _interval.first;
+    centerY = (*function)(_center);
+    fundamental = fundamentalDomain(_interval, _symmetry, _center, _period);
+
+    if (symmetry == ODD)
+    {
+        const std::vector<FunctionToPiecewise::Point> &knots = table.getKnots();
+        bool rising = false;
+        bool falling = false;
+        for (size_t k = 0; k + 1 < knots.size(); k++)
+        {
+            rising |= knots[k + 1].y > knots[k].y;
+            falling |= knots[k + 1].y < knots[k].y;
+        }
+
+        if (rising && falling)
+        {
+            MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "An ODD function must be monotonic on its fundamental domain");
+        }
+    }
+}
+
+float FoldedPiecewise::xToy(float _x)
+{
+    bool mirrored;
+    float x = fold(_x, mirrored);
+    float y;
+
+    // The batch kernel includes the end of the fundamental domain
+    table.xToyBatch(&x, &y, 1);
+
+    if (mirrored && symmetry == ODD)
+        y = 2 * centerY - y;
+    return y;
+}
+
+float FoldedPiecewise::yTox(float _y)
+{
+    float x;
+
+    if (symmetry == ODD)
+    {
+        const std::vector<FunctionToPiecewise::Point> &knots = table.getKnots();
+        float yMin = std::min(knots.front().y, knots.back().y);
+        float yMax = std::max(knots.front().y, knots.back().y);
+
+        // The other half holds the mirrored y values
+        if (_y < yMin || _y > yMax)
+        {
+            float mirroredY = 2 * centerY - _y;
+            table.yToxBatch(&mirroredY, &x, 1);
+            return 2 * center - x;
+        }
+    }
+
+    table.yToxBatch(&_y, &x, 1);
+    return x;
+}
+
+void FoldedPiecewise::xToyBatch(const float *_x, float *_y, size_t _n)
+{
+    const size_t BLOCK_SIZE = 64;
+    float folded[BLOCK_SIZE];
+    bool mirrored[BLOCK_SIZE];
+
+    for (size_t begin = 0; begin < _n; begin += BLOCK_SIZE)
+    {
+        size_t n = std::min(BLOCK_SIZE, _n - begin);
+
+        for (size_t i = 0; i < n; i++)
+            folded[i] = fold(_x[begin + i], mirrored[i]);
+
+        table.xToyBatch(folded, _y + begin, n);
+
+        if (symmetry == ODD)
+        {
+            for (size_t i = 0; i < n; i++)
+            {
+                if (mirrored[i])
+                    _y[begin + i] = 2 * centerY - _y[begin + i];
+            }
+        }
+    }
+}
+
+const FunctionToPiecewise &FoldedPiecewise::getFundamental() const
+{
+    return table;
+}
+
+float FoldedPiecewise::fold(float _x, bool &_mirrored) const
+{
+    float x = _x;
+    _mirrored = false;
+
+    if (period > 0)
+    {
+        x = periodStart + fmodf(x - periodStart, period);
+        if (x < periodStart)
+            x += period;
+    }
+
+    if (symmetry != NONE && x < center)
+    {
+        x = 2 * center - x;
+        _mirrored = true;
+    }
+
+    // Rounding must not push x just out of the table, but inputs that are
+    // really out of the interval still are
+    float slack = 1e-5f * (fundamental.second - fundamental.first);
+    if (x > fundamental.second && x <= fundamental.second + slack)
+        x = fundamental.second;
+    if (x < fundamental.first && x >= fundamental.first - slack)
+        x = fundamental.first;
+
+    return x;
+}
+
+std::vector<FunctionToPiecewise::Point> FoldedPiecewise::tabulate(float (*function)(float), int _nSegments,
+                                                                  std::pair<float, float> _fundamental)
+{
+    if (_nSegments < 1 || !(_fundamental.second > _fundamental.first))
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "Invalid number of segments or fundamental domain");
+    }
+
+    std::vector<FunctionToPiecewise::Point> knots(_nSegments + 1);
+    for (int k = 0; k <= _nSegments; k++)
+    {
+        knots[k].x = _fundamental.first + (_fundamental.second - _fundamental.first) * ((float)k / _nSegments);
+        knots[k].y = (*function)(knots[k].x);
+    }
+
+    return knots;
+}
+
+std::pair<float, float> FoldedPiecewise::fundamentalDomain(std::pair<float, float> _interval, Symmetry _symmetry,
+                                                           float _center, float _period)
+{
+    float start = _interval.first;
+    float end = (_period > 0) ? _interval.first + _period : _interval.second;
+
+    if (_symmetry == NONE)
+        return std::make_pair(start, end);
+
+    if (_period > 0 && fabsf(_center - (start + _period / 2)) > 1e-6f * _period)
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "The center of a periodic symmetric function must be the middle of the period");
+    }
+
+    if (_center < start || _center >= end)
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "The center of the symmetry must be inside the interval");
+    }
+
+    // Inputs left of the center are mirrored into [center, end], with the
+    // same rounding slack as fold()
+    if (_period <= 0 && 2 * _center - start > end + 1e-5f * (end - _center))
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "The half of the interval left of the center must not be longer than the right half");
+    }
+
+    return std::make_pair(_center, end);
+}
+
+#endif //FOLDED_PIECEWISE_H
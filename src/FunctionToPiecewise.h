@@ -15,14 +15,37 @@
 #ifndef FUNCTION_TO_PIECWISE_H
 #define FUNCTION_TO_PIECWISE_H
 
-#include <map>
+#include <vector>
+#include <memory>
 #include <iterator>
 #include "mbed.h"
 #include "Printer.h"
+#include "QueryTrace.h"
+#include "BatchLookup.h"
+#include "KernelDispatch.h"
+#include "AffineCorrection.h"
+#include "StridedView.h"
+#include "SegmentBuffer.h"
+
+PIECEWISE_NO_CONTRACT_BEGIN
 
 class FunctionToPiecewise
 {
 public:
+    // A linear function represented by its slope and y-intercept
+    typedef struct
+    {
+        float slope;
+        float yint;
+    } LineFunc;
+
+    // A point on the xy plane
+    typedef struct
+    {
+        float x;
+        float y;
+    } Point;
+
     // @param float (*function)(float)  A function pointer that represents a function
     //                                  that this piecewise function will represent.
     // @param _nSegments    The number of linear piecewise functions to slice
@@ -30,6 +53,14 @@ public:
     // @param _interval     The interval of the passed function to be converted
     //                      into a piecewise function.
     FunctionToPiecewise(float (*function)(float), int _nSegments, std::pair<float, float> _interval);
+
+    // Builds the piecewise function directly from its knots instead of
+    // sampling a function, e.g. from the output of a curve fitter.
+    //
+    // @param _knots    The knots of the piecewise function sorted by
+    //                  ascending x. Every pair of consecutive knots
+    //                  becomes one segment.
+    FunctionToPiecewise(const std::vector<Point> &_knots);
     virtual ~FunctionToPiecewise();
 
     // Takes an x value and returns y.
@@ -46,30 +77,238 @@ public:
     // @return      The x value of the function.
     float yTox(float _y);
 
-private:
-    // A linear function represented by its slope and y-intercept
-    typedef struct
-    {
-        float slope;
-        float yint;
-    } LineFunc;
+    // Converts _n x values to y at once. Faster than calling xToy() in a
+    // loop, especially for tables much larger than the cache (see
+    // BatchLookup.h). Runs the kernel variant selected for the CPU (see
+    // KernelDispatch.h). The end of the interval is included.
+    //
+    // @param _x    Array of _n x values
+    // @param _y    Array that receives the _n y values
+    // @param _n    The number of values
+    void xToyBatch(const float *_x, float *_y, size_t _n) const;
 
-    // A point on the xy plane
+    // Converts _n y values to x at once, like xToyBatch(). Functions that
+    // are not monotonic fall back to calling yTox() for every value.
+    //
+    // @param _y    Array of _n y values
+    // @param _x    Array that receives the _n x values
+    // @param _n    The number of values
+    void yToxBatch(const float *_y, float *_x, size_t _n);
+
+    // Same as xToyBatch() for one unit of a shared master table, with the
+    // unit's correction applied inside the kernel (see AffineCorrection.h)
+    //
+    // @param _correction   The unit's correction
+    void xToyBatch(const float *_x, float *_y, size_t _n, const AffineCorrection &_correction) const;
+
+    // Same as yToxBatch() for one unit of a shared master table
+    //
+    // @param _correction   The unit's correction
+    void yToxBatch(const float *_y, float *_x, size_t _n, const AffineCorrection &_correction);
+
+    // Same as xToyBatch() on strided views, e.g. fields of an array of
+    // frames (see StridedView.h). Nothing is copied; the outputs may be
+    // written into the same frames the inputs are read from.
+    //
+    // @param _x            View of _n x values
+    // @param _y            View that receives the _n y values
+    // @param _n            The number of values
+    // @param _correction   The unit's correction, none by default
+    void xToyBatch(ConstStridedView _x, StridedView _y, size_t _n,
+                   const AffineCorrection &_correction = AffineCorrection::identity()) const;
+
+    // Same as yToxBatch() on strided views, like the xToyBatch() above
+    void yToxBatch(ConstStridedView _y, StridedView _x, size_t _n,
+                   const AffineCorrection &_correction = AffineCorrection::identity());
+
+    // Measures the largest error of every segment against the original
+    // function by sampling it densely, for both xToy() and yTox(). The
+    // bounds are then returned by xToyWithError() and yToxWithError().
+    // Only for piecewise functions built from a function.
+    //
+    // @param _samplesPerSegment    The number of samples per segment
+    void computeErrorBounds(int _samplesPerSegment = 32);
+
+    // Same as xToy() but also returns how far the result may be from the
+    // original function.
+    //
+    // @param _x            The x value
+    // @param _errorBound   Receives the largest error of the segment, or
+    //                      INFINITY if computeErrorBounds() was not called
+    //                      or the segment was changed since.
+    // @return              The y value
+    float xToyWithError(float _x, float &_errorBound) const;
+
+    // Same as yTox() but also returns how far the result may be from the
+    // x at which the original function reaches _y.
+    //
+    // @param _y            The y value
+    // @param _errorBound   Receives the largest error of the segment, or
+    //                      INFINITY, see xToyWithError()
+    // @return              The x value
+    float yToxWithError(float _y, float &_errorBound) const;
+
+    // Same as xToy() but also returns the slope dy/dx of the segment, e.g.
+    // the Jacobian of a Kalman filter's measurement (see PiecewiseEKF.h).
+    //
+    // @param _x        The x value
+    // @param _slope    Receives the slope at _x
+    // @return          The y value
+    float xToyWithSlope(float _x, float &_slope) const;
+
+    // Converts _n x values to y and their slopes at once, with the batch
+    // kernel of xToyBatch()
+    //
+    // @param _x        Array of _n x values
+    // @param _y        Array that receives the _n y values
+    // @param _slopes   Array that receives the _n slopes
+    // @param _n        The number of values
+    void xToyBatchWithSlope(const float *_x, float *_y, float *_slopes, size_t _n) const;
+
+    // Converts _n y values to x and hands every x straight to _reducer
+    // instead of writing it to an output array. Consecutive samples
+    // usually fall in the same segment, so for monotonic functions the
+    // last segment is checked before searching the table.
+    //
+    // @param _y        Array of _n y values
+    // @param _n        The number of y values
+    // @param _reducer  Any object with a "void add(float _x)" method,
+    //                  e.g. one of the reducers in DistanceStats.h
+    template <class Reducer>
+    void yToxReduce(const float *_y, size_t _n, Reducer &_reducer);
+
+    // Returns the x-intervals whose y-values fall in a y-interval, e.g. the
+    // flux window that corresponds to a distance window. If the function
+    // is monotonic this is a single interval found by binary search in
+    // O(log n), otherwise every segment is checked.
+    //
+    // @param _yInterval    The y-interval, first <= second
+    // @return              The x-intervals sorted by ascending x, empty if
+    //                      the function never reaches the y-interval.
+    std::vector<std::pair<float, float>> yIntervalTox(std::pair<float, float> _yInterval) const;
+
+    // Memory used by the table
     typedef struct
     {
-        float x;
-        float y;
-    } Point;
+        size_t knotBytes;
+        // The flat knots and segments of the batch kernels
+        size_t segmentBytes;
+        // The flat error bounds of the segments
+        size_t errorBytes;
+        // How every flat buffer is backed
+        SegmentMemory::Backing knotXsBacking;
+        SegmentMemory::Backing knotYsBacking;
+        SegmentMemory::Backing xSegmentsBacking;
+        SegmentMemory::Backing ySegmentsBacking;
+        SegmentMemory::Backing xErrorsBacking;
+        SegmentMemory::Backing yErrorsBacking;
+    } Footprint;
+
+    // @return  The memory used by the table
+    Footprint getFootprint() const;
+
+    // Prints getFootprint()
+    void printFootprint() const;
+
+    // Records the input of every following xToy() and yTox() call, e.g.
+    // to replay production traffic with TraceReplay.h.
+    //
+    // @param _trace    The trace to record to, nullptr stops recording. It
+    //                  must outlive this object or be detached first.
+    //                  Copies made while recording record to the same
+    //                  trace, which is not thread safe, so detach it from
+    //                  copies handed to other threads.
+    void setTrace(QueryTrace *_trace);
+
+    // Returns the knots (segment end points) of the piecewise function
+    // sorted by ascending x.
+    const std::vector<Point> &getKnots() const;
+
+    // Returns the flat f(x) segments that the batch kernels use. Segment i
+    // runs from knot i to knot i + 1, so there are getKnots().size() - 1.
+    // Valid until this object or its table changes.
+    const LineFunc *getXSegments() const;
+
+    // Returns the flat f(y) segments, in the same order as getXSegments()
+    const LineFunc *getYSegments() const;
+
+    // Moves the y-value of one knot and rebuilds only the (at most two)
+    // segments that touch it, in place in O(1). Copies made before keep the
+    // old table, so the first call on a shared table copies it in O(n).
+    //
+    // @param _index    The index of the knot in getKnots()
+    // @param _y        The new y-value of the knot
+    void setKnotY(size_t _index, float _y);
 
+private:
     // Holds the function that this piecewise represents.
     // This function was passed in through the constructor
     float (*originalFunciton)(float);
 
-    // Holds interval along the x-axis and the f(x) Function
-    std::map<std::pair<float, float>, LineFunc> f_of_x_fns;
+    // Everything that is built from the function. Copies of a
+    // FunctionToPiecewise share one Table by reference count, so copying
+    // is O(1) and never allocates, e.g. when handing a copy to another
+    // thread or an ISR. A Table is never changed while it is shared;
+    // setKnotY() copies it first.
+    struct Table
+    {
+        // Holds the knots of the piecewise function sorted by ascending x
+        std::vector<Point> knots;
+
+        // The number of rising and falling segments. If either is 0 the
+        // function is monotonic.
+        int nRisingSegments;
+        int nFallingSegments;
+
+        // Flat copies of the knots and segments for the batch kernels.
+        // Segment i runs from knot i to knot i + 1.
+        // Backed by huge pages on hosts if SegmentMemory's policy asks
+        // for it, see SegmentBuffer.h.
+        SegmentBuffer<float> knotXs;
+        SegmentBuffer<float> knotYs;
+        SegmentBuffer<LineFunc> xSegments;
+        SegmentBuffer<LineFunc> ySegments;
+
+        // The largest error of every segment's f(x) and f(y) functions
+        // against the original function, INFINITY if unknown
+        SegmentBuffer<float> xErrors;
+        SegmentBuffer<float> yErrors;
+    };
+
+    std::shared_ptr<Table> table;
+
+    // The trace that queries are recorded to, if any
+    QueryTrace *trace;
+
+    // Rebuilds the flat copies of all knots and segments in the table
+    void buildFlatSegments();
+
+    // Returns the index of the segment whose x-interval holds _x
+    size_t findXSegment(float _x) const;
 
-    // Holds interval along the x-axis and the f(y) Function
-    std::map<std::pair<float, float>, LineFunc> f_of_y_fns;
+    // Returns the index of the first segment whose y-range holds _y
+    size_t findYSegment(float _y) const;
+
+    // Updates the flat copy of one segment from the knots
+    //
+    // @param _index    The index of the segment
+    void updateFlatSegment(size_t _index);
+
+    // Updates nRisingSegments and nFallingSegments for one segment
+    //
+    // @param _pt1      Left point of the segment
+    // @param _pt2      Right point of the segment
+    // @param _delta    1 if the segment is added, -1 if it is removed
+    void countSegment(Point _pt1, Point _pt2, int _delta);
+
+    // Returns the x-value at which the segment between two points reaches
+    // a y-value
+    //
+    // @param _pt1  First point of the segment
+    // @param _pt2  Second point of the segment
+    // @param _y    The y-value, between _pt1.y and _pt2.y
+    // @return      The x-value
+    static float segmentYTox(Point _pt1, Point _pt2, float _y);
 
     // Evaluates a linear function given the linear function and an x-value
     //
@@ -93,12 +332,12 @@ private:
     float getLineFuncYInt(Point _pt1, Point _pt2);
 };
 
-#endif //FUNCTION_TO_PIECWISE_H
-
 FunctionToPiecewise::FunctionToPiecewise(float (*function)(float), int _nSegments, std::pair<float, float> _interval)
 {
     // Store the passed function in member variable
     originalFunciton = function;
+    table = std::make_shared<Table>();
+    trace = nullptr;
 
     // The "subinterval" of the full interval.
     // In other words, if we want to break the below function into 10 segments
@@ -117,15 +356,12 @@ FunctionToPiecewise::FunctionToPiecewise(float (*function)(float), int _nSegment
     //
     float xIncrement = (_interval.second - _interval.first) / _nSegments;
 
-    // ---------------------------------------------------------------------
-
-    // Set the f_of_x_fns' intervals and functions
+    // Sample the function at every knot, the segments are built from the
+    // knots by buildFlatSegments()
     for (float x = _interval.first; x < _interval.second; x += xIncrement)
     {
         Point tempPt1;
         Point tempPt2;
-        LineFunc tempLineFunc;
-        std::pair<float, float> tempSubInterval;
 
         tempPt1.x = x;
         tempPt1.y = (*function)(tempPt1.x);
@@ -133,125 +369,466 @@ FunctionToPiecewise::FunctionToPiecewise(float (*function)(float), int _nSegment
         tempPt2.x = x + xIncrement;
         tempPt2.y = (*function)(tempPt2.x);
 
-        tempLineFunc.slope = getLineFuncSlope(tempPt1, tempPt2);
-        tempLineFunc.yint = getLineFuncYInt(tempPt1, tempPt2);
+        if (table->knots.empty())
+            table->knots.push_back(tempPt1);
+        table->knots.push_back(tempPt2);
+    }
 
-        // Assigns the subinterval, BUT insures that the second number in the
-        // interval (tempSubinterval.second) is always greater than the first
-        // number (tempSubinterval.first). The second # must be greater
-        // or else the check for if a number is within the interval (this
-        // check occurs in the "xToy" and "yTox" intervals) will fail.
-        if (tempPt1.y > tempPt2.y)
-        {
-            tempSubInterval.first = tempPt2.y;
-            tempSubInterval.second = tempPt1.y;
-        }
-        else if (tempPt2.y > tempPt1.y)
+    table->nRisingSegments = 0;
+    table->nFallingSegments = 0;
+    for (size_t i = 0; i + 1 < table->knots.size(); i++)
+    {
+        countSegment(table->knots[i], table->knots[i + 1], 1);
+    }
+
+    buildFlatSegments();
+}
+
+FunctionToPiecewise::FunctionToPiecewise(const std::vector<Point> &_knots)
+{
+    // There is no function behind a table built from knots
+    originalFunciton = nullptr;
+    table = std::make_shared<Table>();
+    trace = nullptr;
+
+    if (_knots.size() < 2)
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "At least 2 knots are needed to build a piecewise function");
+    }
+
+    table->knots = _knots;
+    table->nRisingSegments = 0;
+    table->nFallingSegments = 0;
+
+    for (size_t i = 0; i + 1 < table->knots.size(); i++)
+    {
+        countSegment(table->knots[i], table->knots[i + 1], 1);
+    }
+
+    buildFlatSegments();
+}
+
+FunctionToPiecewise::~FunctionToPiecewise()
+{
+}
+
+FunctionToPiecewise::Footprint FunctionToPiecewise::getFootprint() const
+{
+    Footprint footprint;
+    footprint.knotBytes = table->knots.capacity() * sizeof(Point);
+    footprint.segmentBytes = (table->knotXs.size() + table->knotYs.size()) * sizeof(float) +
+                             (table->xSegments.size() + table->ySegments.size()) * sizeof(LineFunc);
+    footprint.errorBytes = (table->xErrors.size() + table->yErrors.size()) * sizeof(float);
+    footprint.knotXsBacking = table->knotXs.getBacking();
+    footprint.knotYsBacking = table->knotYs.getBacking();
+    footprint.xSegmentsBacking = table->xSegments.getBacking();
+    footprint.ySegmentsBacking = table->ySegments.getBacking();
+    footprint.xErrorsBacking = table->xErrors.getBacking();
+    footprint.yErrorsBacking = table->yErrors.getBacking();
+    return footprint;
+}
+
+void FunctionToPiecewise::printFootprint() const
+{
+    Footprint footprint = getFootprint();
+    Printer::pc.printf("Knots: %u bytes, segments: %u bytes, errors: %u bytes\n",
+                       (unsigned)footprint.knotBytes,
+                       (unsigned)footprint.segmentBytes, (unsigned)footprint.errorBytes);
+    Printer::pc.printf("Knot x: %s, knot y: %s, x segments: %s, y segments: %s, x errors: %s, y errors: %s\n",
+                       SegmentMemory::name(footprint.knotXsBacking), SegmentMemory::name(footprint.knotYsBacking),
+                       SegmentMemory::name(footprint.xSegmentsBacking), SegmentMemory::name(footprint.ySegmentsBacking),
+                       SegmentMemory::name(footprint.xErrorsBacking), SegmentMemory::name(footprint.yErrorsBacking));
+}
+
+void FunctionToPiecewise::setTrace(QueryTrace *_trace)
+{
+    trace = _trace;
+}
+
+const std::vector<FunctionToPiecewise::Point> &FunctionToPiecewise::getKnots() const
+{
+    return table->knots;
+}
+
+const FunctionToPiecewise::LineFunc *FunctionToPiecewise::getXSegments() const
+{
+    return table->xSegments.data();
+}
+
+const FunctionToPiecewise::LineFunc *FunctionToPiecewise::getYSegments() const
+{
+    return table->ySegments.data();
+}
+
+void FunctionToPiecewise::setKnotY(size_t _index, float _y)
+{
+    if (_index >= table->knots.size())
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "Knot index is out of range");
+    }
+
+    // Other copies may share the table, give this one its own
+    if (table.use_count() > 1)
+        table = std::make_shared<Table>(*table);
+
+    if (_index > 0)
+        countSegment(table->knots[_index - 1], table->knots[_index], -1);
+    if (_index + 1 < table->knots.size())
+        countSegment(table->knots[_index], table->knots[_index + 1], -1);
+
+    table->knots[_index].y = _y;
+
+    if (_index > 0)
+        countSegment(table->knots[_index - 1], table->knots[_index], 1);
+    if (_index + 1 < table->knots.size())
+        countSegment(table->knots[_index], table->knots[_index + 1], 1);
+
+    table->knotYs[_index] = _y;
+    if (_index > 0)
+        updateFlatSegment(_index - 1);
+    if (_index + 1 < table->knots.size())
+        updateFlatSegment(_index);
+}
+
+void FunctionToPiecewise::xToyBatch(const float *_x, float *_y, size_t _n) const
+{
+    xToyBatch(ConstStridedView(_x), StridedView(_y), _n);
+}
+
+void FunctionToPiecewise::yToxBatch(const float *_y, float *_x, size_t _n)
+{
+    yToxBatch(ConstStridedView(_y), StridedView(_x), _n);
+}
+
+void FunctionToPiecewise::xToyBatch(const float *_x, float *_y, size_t _n, const AffineCorrection &_correction) const
+{
+    xToyBatch(ConstStridedView(_x), StridedView(_y), _n, _correction);
+}
+
+void FunctionToPiecewise::yToxBatch(const float *_y, float *_x, size_t _n, const AffineCorrection &_correction)
+{
+    yToxBatch(ConstStridedView(_y), StridedView(_x), _n, _correction);
+}
+
+void FunctionToPiecewise::xToyBatch(ConstStridedView _x, StridedView _y, size_t _n,
+                                    const AffineCorrection &_correction) const
+{
+    KernelDispatch<LineFunc>::lookup()(table->knotXs.data(), table->xSegments.data(), table->xSegments.size(), 1,
+                                       _correction.inGain, _correction.inOffset,
+                                       _correction.outGain, _correction.outOffset,
+                                       _x.first, _x.stride, _y.first, _y.stride, _n, nullptr);
+}
+
+void FunctionToPiecewise::yToxBatch(ConstStridedView _y, StridedView _x, size_t _n,
+                                    const AffineCorrection &_correction)
+{
+    // The inverse of the unit's function: x = (f^-1((y - outOffset) / outGain) - inOffset) / inGain
+    float preGain = 1 / _correction.outGain;
+    float preOffset = -_correction.outOffset / _correction.outGain;
+    float postGain = 1 / _correction.inGain;
+    float postOffset = -_correction.inOffset / _correction.inGain;
+
+    if (table->nRisingSegments > 0 && table->nFallingSegments > 0)
+    {
+        for (size_t i = 0; i < _n; i++)
+            _x[i] = postGain * yTox(preGain * _y[i] + preOffset) + postOffset;
+        return;
+    }
+
+    float sign = (table->nRisingSegments > 0) ? 1 : -1;
+    KernelDispatch<LineFunc>::lookup()(table->knotYs.data(), table->ySegments.data(), table->ySegments.size(), sign,
+                                       preGain, preOffset, postGain, postOffset,
+                                       _y.first, _y.stride, _x.first, _x.stride, _n, nullptr);
+}
+
+void FunctionToPiecewise::computeErrorBounds(int _samplesPerSegment)
+{
+    if (originalFunciton == nullptr || _samplesPerSegment < 1)
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "Error bounds need the original function and at least 1 sample per segment");
+    }
+
+    // Other copies may share the table, give this one its own
+    if (table.use_count() > 1)
+        table = std::make_shared<Table>(*table);
+
+    for (size_t i = 0; i < table->xSegments.size(); i++)
+    {
+        Point pt1 = table->knots[i];
+        Point pt2 = table->knots[i + 1];
+        float xError = 0;
+        float yError = 0;
+
+        for (int j = 0; j <= _samplesPerSegment; j++)
         {
-            tempSubInterval.first = tempPt1.y;
-            tempSubInterval.second = tempPt2.y;
+            // Error of f(x) at evenly spaced x
+            float x = pt1.x + (pt2.x - pt1.x) * ((float)j / _samplesPerSegment);
+            float y = evalLinearFunction(x, table->xSegments[i]);
+            xError = std::max(xError, fabsf(y - (*originalFunciton)(x)));
+
+            // Error of f(y) at evenly spaced y. The original function
+            // reaches y somewhere in the segment since it passes through
+            // both knots; find where by bisection.
+            float yQuery = pt1.y + (pt2.y - pt1.y) * ((float)j / _samplesPerSegment);
+            float low = pt1.x;
+            float high = pt2.x;
+            for (int k = 0; k < 32; k++)
+            {
+                float mid = (low + high) / 2;
+                if (((*originalFunciton)(mid) - yQuery) * (pt1.y - yQuery) > 0)
+                    low = mid;
+                else
+                    high = mid;
+            }
+            yError = std::max(yError, fabsf(evalLinearFunction(yQuery, table->ySegments[i]) - (low + high) / 2));
         }
 
-        tempSubInterval.first = tempPt1.x;
-        tempSubInterval.second = tempPt2.x;
-
-        f_of_x_fns.insert(std::make_pair(tempSubInterval, tempLineFunc));
+        table->xErrors[i] = xError;
+        table->yErrors[i] = yError;
     }
+}
+
+float FunctionToPiecewise::xToyWithError(float _x, float &_errorBound) const
+{
+    size_t i = findXSegment(_x);
+    _errorBound = table->xErrors[i];
+    return (table->xSegments[i].slope * _x) + table->xSegments[i].yint;
+}
 
-    //------------------------------------------------------------------------
+float FunctionToPiecewise::yToxWithError(float _y, float &_errorBound) const
+{
+    size_t i = findYSegment(_y);
+    _errorBound = table->yErrors[i];
+    return (table->ySegments[i].slope * _y) + table->ySegments[i].yint;
+}
 
-    // Set the f_of_y_fns' intervals and functions
-    // The for loop is still in terms of x because if it were in terms of y,
-    // we would have to evaluate the passed (*function) pointer for y,
-    // which we can't do; we can only evaluate it for x.
-    for (float x = _interval.first; x < _interval.second; x += xIncrement)
+float FunctionToPiecewise::xToyWithSlope(float _x, float &_slope) const
+{
+    size_t i = findXSegment(_x);
+    _slope = table->xSegments[i].slope;
+    return (table->xSegments[i].slope * _x) + table->xSegments[i].yint;
+}
+
+void FunctionToPiecewise::xToyBatchWithSlope(const float *_x, float *_y, float *_slopes, size_t _n) const
+{
+    KernelDispatch<LineFunc>::lookup()(table->knotXs.data(), table->xSegments.data(), table->xSegments.size(), 1,
+                                       1, 0, 1, 0, _x, sizeof(float), _y, sizeof(float), _n, _slopes);
+}
+
+size_t FunctionToPiecewise::findXSegment(float _x) const
+{
+    size_t nSegments = table->xSegments.size();
+
+    if (!(_x >= table->knotXs[0] && _x <= table->knotXs[nSegments]))
     {
-        Point tempPt1;
-        Point tempPt2;
-        LineFunc tempLineFunc;
-        std::pair<float, float> tempSubInterval;
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "_x value is out of the piecewise function's interval");
+    }
 
-        tempPt1.x = x;
-        tempPt1.y = (*function)(tempPt1.x);
+    // The last knot <= _x, but the end of the interval belongs to the last segment
+    const float *knot = std::upper_bound(table->knotXs.data(), table->knotXs.data() + nSegments, _x);
+    return (knot - table->knotXs.data()) - 1;
+}
 
-        tempPt2.x = x + xIncrement;
-        tempPt2.y = (*function)(tempPt2.x);
+size_t FunctionToPiecewise::findYSegment(float _y) const
+{
+    size_t nSegments = table->ySegments.size();
+    const float *knotYs = table->knotYs.data();
+
+    if (table->nRisingSegments == 0 || table->nFallingSegments == 0)
+    {
+        float sign = (table->nRisingSegments > 0) ? 1 : -1;
+        float key = sign * _y;
 
-        // getLineFuncSlope() will give us the f(x) slope "m". We want the
-        // f(y) slope which is 1/m
-        // y=mx+b --> x=(y-b)/m  or  x=(y/m)-(b/m)
-        tempLineFunc.slope = 1 / getLineFuncSlope(tempPt1, tempPt2);
-
-        // getLineFuncYInt() will give us the f(x) y-int "b". We want the
-        // f(y) y-int which is -b/x
-        // y=mx+b --> x=(y-b)/m  or  x=(y/m)-(b/m)
-        tempLineFunc.yint = (-1 * getLineFuncYInt(tempPt1, tempPt2)) / getLineFuncSlope(tempPt1, tempPt2);
-
-        // Assigns the subinterval, BUT insures that the second number in the
-        // interval (tempSubinterval.second) is always greater than the first
-        // number (tempSubinterval.first). The second # must be greater
-        // or else the check for if a number is within the interval (this
-        // check occurs in the "xToy" and "yTox" intervals) will fail.
-        if (tempPt1.y > tempPt2.y)
+        if (key >= sign * knotYs[0] && key <= sign * knotYs[nSegments])
         {
-            tempSubInterval.first = tempPt2.y;
-            tempSubInterval.second = tempPt1.y;
+            const float *knot = std::upper_bound(knotYs, knotYs + nSegments, key,
+                                                 [=](float value, float knotY) {
+                                                     return value < sign * knotY;
+                                                 });
+            return (knot - knotYs) - 1;
         }
-        else if (tempPt2.y > tempPt1.y)
+    }
+    else
+    {
+        for (size_t i = 0; i < nSegments; i++)
         {
-            tempSubInterval.first = tempPt1.y;
-            tempSubInterval.second = tempPt2.y;
+            if (_y >= std::min(knotYs[i], knotYs[i + 1]) && _y <= std::max(knotYs[i], knotYs[i + 1]))
+                return i;
         }
-
-        // Printer::pc.printf("tempSubInterval.first: %f\n", tempSubInterval.first);
-        // Printer::pc.printf("tempSubInterval.second: %f\n", tempSubInterval.second);
-
-        f_of_y_fns.insert(std::make_pair(tempSubInterval, tempLineFunc));
     }
+
+    MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "_y value is out of the piecewise function's range");
+    return 0;
 }
 
-FunctionToPiecewise::~FunctionToPiecewise()
+void FunctionToPiecewise::buildFlatSegments()
 {
+    size_t nKnots = table->knots.size();
+    table->knotXs.resize(nKnots);
+    table->knotYs.resize(nKnots);
+    table->xSegments.resize(nKnots - 1);
+    table->ySegments.resize(nKnots - 1);
+    table->xErrors.resize(nKnots - 1);
+    table->yErrors.resize(nKnots - 1);
+
+    for (size_t i = 0; i < nKnots; i++)
+    {
+        table->knotXs[i] = table->knots[i].x;
+        table->knotYs[i] = table->knots[i].y;
+    }
+
+    KernelDispatch<LineFunc>::build()(table->knotXs.data(), table->knotYs.data(),
+                                      table->xSegments.data(), table->ySegments.data(), nKnots - 1);
+
+    // The segments are new, their errors are unknown until computeErrorBounds()
+    for (size_t i = 0; i + 1 < nKnots; i++)
+    {
+        table->xErrors[i] = INFINITY;
+        table->yErrors[i] = INFINITY;
+    }
 }
 
-float FunctionToPiecewise::xToy(float _x)
+void FunctionToPiecewise::updateFlatSegment(size_t _index)
 {
-    auto iter = std::find_if(f_of_x_fns.cbegin(), f_of_x_fns.cend(),
-                             // [=] means pass any variables by value to the lambda
-                             [=](const std::pair<std::pair<float, float>, LineFunc> &fn) {
-                                 return _x >= fn.first.first && _x < fn.first.second;
-                             });
+    Point pt1 = table->knots[_index];
+    Point pt2 = table->knots[_index + 1];
+
+    table->xSegments[_index].slope = getLineFuncSlope(pt1, pt2);
+    table->xSegments[_index].yint = getLineFuncYInt(pt1, pt2);
 
-    // If the _x value is out of range of the piecewise, throw error
-    if (iter == f_of_x_fns.end())
+    // y=mx+b --> x=(y/m)-(b/m), a flat segment returns its left knot like
+    // BatchLookup::buildSegments()
+    if (table->xSegments[_index].slope != 0)
     {
-        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "_x value is out of the piecewise function's interval");
+        table->ySegments[_index].slope = 1 / table->xSegments[_index].slope;
+        table->ySegments[_index].yint = (-1 * table->xSegments[_index].yint) / table->xSegments[_index].slope;
     }
+    else
+    {
+        table->ySegments[_index].slope = 0;
+        table->ySegments[_index].yint = pt1.x;
+    }
+
+    // The segment changed, its error is unknown until computeErrorBounds()
+    table->xErrors[_index] = INFINITY;
+    table->yErrors[_index] = INFINITY;
+}
 
-    return evalLinearFunction(_x, iter->second);
+float FunctionToPiecewise::xToy(float _x)
+{
+    if (trace)
+        trace->record(QueryTrace::X_TO_Y, _x);
+
+    // The same segments and closed interval as xToyBatch()
+    return evalLinearFunction(_x, table->xSegments[findXSegment(_x)]);
 }
 
 float FunctionToPiecewise::yTox(float _y)
 {
-    auto iter = std::find_if(f_of_y_fns.cbegin(), f_of_y_fns.cend(),
-                             // [=] means pass any variables by value to the lambda
-                             [=](const std::pair<std::pair<float, float>, LineFunc> &fn) {
-                                 return _y >= fn.first.first && _y < fn.first.second;
-                             });
+    if (trace)
+        trace->record(QueryTrace::Y_TO_X, _y);
 
-        // Printer::pc.printf("%f\n", f_of_y_fns);
-    // Printer::pc.printf("%f\n", iter->first.first);
-    // Printer::pc.printf("%f\n", iter->first.second);
-    // Printer::pc.printf("%f\n", iter->second);
+    // The same segments and closed range as yToxBatch()
+    return evalLinearFunction(_y, table->ySegments[findYSegment(_y)]);
+}
 
-    // If the _x value is out of range of the piecewise, throw error
-    if (iter == f_of_y_fns.end())
+std::vector<std::pair<float, float>> FunctionToPiecewise::yIntervalTox(std::pair<float, float> _yInterval) const
+{
+    std::vector<std::pair<float, float>> xIntervals;
+
+    if (table->nRisingSegments == 0 || table->nFallingSegments == 0)
     {
-        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "_y value is out of the piecewise function's range");
+        // Search in terms of key = sign * y so the knots are always
+        // ascending, whether the function rises or falls.
+        float sign = (table->nRisingSegments > 0) ? 1 : -1;
+        float keyLow = (sign > 0) ? _yInterval.first : -_yInterval.second;
+        float keyHigh = (sign > 0) ? _yInterval.second : -_yInterval.first;
+
+        if (keyHigh < sign * table->knots.front().y || keyLow > sign * table->knots.back().y)
+            return xIntervals;
+
+        // First knot with key >= keyLow
+        auto low = std::lower_bound(table->knots.begin(), table->knots.end(), keyLow,
+                                    [=](const Point &pt, float key) {
+                                        return sign * pt.y < key;
+                                    });
+        // First knot with key > keyHigh
+        auto high = std::upper_bound(table->knots.begin(), table->knots.end(), keyHigh,
+                                     [=](float key, const Point &pt) {
+                                         return key < sign * pt.y;
+                                     });
+
+        std::pair<float, float> xInterval;
+        if (low == table->knots.begin() || low->y == sign * keyLow)
+            xInterval.first = low->x;
+        else
+            xInterval.first = segmentYTox(*(low - 1), *low, sign * keyLow);
+
+        if (high == table->knots.end())
+            xInterval.second = table->knots.back().x;
+        else
+            xInterval.second = segmentYTox(*(high - 1), *high, sign * keyHigh);
+
+        xIntervals.push_back(xInterval);
+        return xIntervals;
     }
 
-    // Uses the opposite of y=mx+b --> x = (y-b)/x
-    return evalLinearFunction(_y, iter->second);
+    for (size_t i = 0; i + 1 < table->knots.size(); i++)
+    {
+        Point pt1 = table->knots[i];
+        Point pt2 = table->knots[i + 1];
+        float yMin = std::min(pt1.y, pt2.y);
+        float yMax = std::max(pt1.y, pt2.y);
+
+        if (_yInterval.second < yMin || _yInterval.first > yMax)
+            continue;
+
+        std::pair<float, float> xInterval;
+        if (yMin == yMax)
+        {
+            xInterval = std::make_pair(pt1.x, pt2.x);
+        }
+        else
+        {
+            float xA = segmentYTox(pt1, pt2, std::max(_yInterval.first, yMin));
+            float xB = segmentYTox(pt1, pt2, std::min(_yInterval.second, yMax));
+            xInterval = std::make_pair(std::min(xA, xB), std::max(xA, xB));
+        }
+
+        // Merge with the previous interval if they touch
+        if (!xIntervals.empty() && xIntervals.back().second >= xInterval.first)
+            xIntervals.back().second = std::max(xIntervals.back().second, xInterval.second);
+        else
+            xIntervals.push_back(xInterval);
+    }
+
+    return xIntervals;
+}
+
+template <class Reducer>
+void FunctionToPiecewise::yToxReduce(const float *_y, size_t _n, Reducer &_reducer)
+{
+    const float *knotYs = table->knotYs.data();
+    const LineFunc *segments = table->ySegments.data();
+    size_t nSegments = table->ySegments.size();
+    bool monotonic = table->nRisingSegments == 0 || table->nFallingSegments == 0;
+    float sign = (table->nRisingSegments > 0) ? 1 : -1;
+    size_t k = nSegments;
+
+    for (size_t i = 0; i < _n; i++)
+    {
+        float y = _y[i];
+        float key = sign * y;
+
+        // Reuse the last segment if findYSegment() would pick it too
+        if (!(monotonic && k < nSegments && key >= sign * knotYs[k] &&
+              (key < sign * knotYs[k + 1] || (k + 1 == nSegments && key <= sign * knotYs[k + 1]))))
+        {
+            k = findYSegment(y);
+        }
+
+        _reducer.add((segments[k].slope * y) + segments[k].yint);
+    }
 }
 
 // float FunctionToPiecewise::yTox(float _y)
@@ -273,6 +850,19 @@ float FunctionToPiecewise::yTox(float _y)
 //     return (_y - iter->second.yint) / iter->second.slope;
 // }
 
+void FunctionToPiecewise::countSegment(Point _pt1, Point _pt2, int _delta)
+{
+    if (_pt2.y > _pt1.y)
+        table->nRisingSegments += _delta;
+    else if (_pt2.y < _pt1.y)
+        table->nFallingSegments += _delta;
+}
+
+float FunctionToPiecewise::segmentYTox(Point _pt1, Point _pt2, float _y)
+{
+    return _pt1.x + (_y - _pt1.y) * (_pt2.x - _pt1.x) / (_pt2.y - _pt1.y);
+}
+
 float FunctionToPiecewise::evalLinearFunction(float _x, LineFunc _line)
 {
     return (_line.slope * _x) + _line.yint;
@@ -286,4 +876,8 @@ float FunctionToPiecewise::getLineFuncSlope(Point _pt1, Point _pt2)
 float FunctionToPiecewise::getLineFuncYInt(Point _pt1, Point _pt2)
 {
     return _pt1.y - (getLineFuncSlope(_pt1, _pt2) * _pt1.x);
-}
\ No newline at end of file
+}
+
+PIECEWISE_NO_CONTRACT_END
+
+#endif //FUNCTION_TO_PIECWISE_H
@@ -0,0 +1,228 @@
+// File: ImplicitPiecewise.h
+// Author: David Antaki
+// Date: 10/18/2026
+// License: Closed source
+//
+// Contents: Tabulates a function that is only defined implicitly by a
+// relation g(x, y) = 0, e.g. a sensor model that cannot be solved for y.
+// The curve is traced along the interval by Newton continuation starting
+// from a seed y at the start of the interval. The knots are solved in
+// blocks. The predictor follows the tangent (dy/dx = -(dg/dx)/(dg/dy))
+// from the last solved knot to the first knot of the block and from each
+// predicted knot to the next, so it bends with the curve across the
+// block. The corrector then runs Newton on all knots of the block in
+// lockstep. Every knot still needs its own Newton steps; the block only
+// keeps their independent work in one loop. If a block does not converge,
+// its knots are solved one at a time instead. The derivatives of g are
+// central differences. The knots build a FunctionToPiecewise with the
+// usual xToy() and yTox().
+
+#ifndef IMPLICIT_PIECEWISE_H
+#define IMPLICIT_PIECEWISE_H
+
+#include <vector>
+#include <cmath>
+#include "mbed.h"
+#include "FunctionToPiecewise.h"
+
+class ImplicitPiecewise
+{
+public:
+    // The number of knots solved together
+    static const int BLOCK_SIZE = 16;
+
+    // @param float (*_relation)(float, float)  g(x, y), the curve is g = 0
+    // @param _nSegments    The number of segments of the table
+    // @param _interval     The interval along the x-axis
+    // @param _seedY        A guess of y at the start of the interval, on
+    //                      the branch of the curve that is tabulated
+    // @param _tolerance    Relative accuracy of the solved y values
+    // @param _maxIterations    Newton steps allowed per knot
+    ImplicitPiecewise(float (*_relation)(float, float), int _nSegments, std::pair<float, float> _interval,
+                      float _seedY, float _tolerance = 1e-5, int _maxIterations = 20);
+
+    // Traces the curve.
+    //
+    // @return  The knots sorted by ascending x.
+    std::vector<FunctionToPiecewise::Point> tabulate();
+
+    // Traces the curve and builds its piecewise function.
+    FunctionToPiecewise build();
+
+    // @return  The number of evaluations of the relation by tabulate()
+    size_t getEvaluations() const;
+
+private:
+    float (*relation)(float, float);
+    int nSegments;
+    std::pair<float, float> interval;
+    float seedY;
+    float tolerance;
+    int maxIterations;
+    size_t nEvaluations;
+
+    // @return  g(x, y)
+    float g(float _x, float _y);
+
+    // @return  The finite difference step for y or x at _value
+    static float step(float _value);
+
+    // @return  The slope dy/dx of the curve at (_x, _y)
+    float tangent(float _x, float _y);
+
+    // Runs Newton steps on _n knots in lockstep until all converged
+    //
+    // @param _x        The x values of the knots
+    // @param _y        The start values, receives the solved y values
+    // @param _n        The number of knots
+    // @return          True if all knots converged
+    bool solve(const float *_x, float *_y, int _n);
+};
+
+const int ImplicitPiecewise::BLOCK_SIZE;
+
+ImplicitPiecewise::ImplicitPiecewise(float (*_relation)(float, float), int _nSegments, std::pair<float, float> _interval,
+                                     float _seedY, float _tolerance, int _maxIterations)
+{
+    if (_relation == nullptr || _nSegments < 1 || !(_interval.second > _interval.first) || _maxIterations < 1)
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "Invalid relation, number of segments or interval for the implicit function");
+    }
+
+    relation = _relation;
+    nSegments = _nSegments;
+    interval = _interval;
+    seedY = _seedY;
+    tolerance = _tolerance;
+    maxIterations = _maxIterations;
+    nEvaluations = 0;
+}
+
+std::vector<FunctionToPiecewise::Point> ImplicitPiecewise::tabulate()
+{
+    std::vector<FunctionToPiecewise::Point> knots(nSegments + 1);
+    for (int k = 0; k <= nSegments; k++)
+        knots[k].x = interval.first + (interval.second - interval.first) * ((float)k / nSegments);
+    knots[nSegments].x = interval.second;
+
+    nEvaluations = 0;
+
+    // The first knot starts from the seed
+    knots[0].y = seedY;
+    if (!solve(&knots[0].x, &knots[0].y, 1))
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_DATA_DETECTED), "Newton did not converge from the seed of the implicit function");
+    }
+
+    float xs[BLOCK_SIZE];
+    float ys[BLOCK_SIZE];
+
+    for (int begin = 1; begin <= nSegments; begin += BLOCK_SIZE)
+    {
+        int n = std::min(BLOCK_SIZE, nSegments + 1 - begin);
+        FunctionToPiecewise::Point last = knots[begin - 1];
+
+        // Predictor: one tangent step from each knot to the next, starting
+        // at the last solved knot
+        FunctionToPiecewise::Point predicted = last;
+        for (int i = 0; i < n; i++)
+        {
+            xs[i] = knots[begin + i].x;
+            ys[i] = predicted.y + tangent(predicted.x, predicted.y) * (xs[i] - predicted.x);
+            predicted.x = xs[i];
+            predicted.y = ys[i];
+        }
+
+        if (!solve(xs, ys, n))
+        {
+            // Too far from the tangent: continue one knot at a time
+            for (int i = 0; i < n; i++)
+            {
+                FunctionToPiecewise::Point previous = (i == 0) ? last : FunctionToPiecewise::Point{xs[i - 1], ys[i - 1]};
+                ys[i] = previous.y + tangent(previous.x, previous.y) * (xs[i] - previous.x);
+
+                if (!solve(&xs[i], &ys[i], 1))
+                {
+                    MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_DATA_DETECTED), "Newton continuation of the implicit function did not converge");
+                }
+            }
+        }
+
+        for (int i = 0; i < n; i++)
+            knots[begin + i].y = ys[i];
+    }
+
+    return knots;
+}
+
+FunctionToPiecewise ImplicitPiecewise::build()
+{
+    return FunctionToPiecewise(tabulate());
+}
+
+size_t ImplicitPiecewise::getEvaluations() const
+{
+    return nEvaluations;
+}
+
+float ImplicitPiecewise::g(float _x, float _y)
+{
+    nEvaluations++;
+    return (*relation)(_x, _y);
+}
+
+float ImplicitPiecewise::step(float _value)
+{
+    // About the square root of the float epsilon, scaled to the value
+    return 1e-3f * (1 + fabsf(_value));
+}
+
+float ImplicitPiecewise::tangent(float _x, float _y)
+{
+    float hx = step(_x);
+    float hy = step(_y);
+    float gx = (g(_x + hx, _y) - g(_x - hx, _y)) / (2 * hx);
+    float gy = (g(_x, _y + hy) - g(_x, _y - hy)) / (2 * hy);
+
+    // A vertical tangent is handled by the corrector
+    if (gy == 0 || !std::isfinite(gx / gy))
+        return 0;
+    return -gx / gy;
+}
+
+bool ImplicitPiecewise::solve(const float *_x, float *_y, int _n)
+{
+    bool converged[BLOCK_SIZE];
+    for (int i = 0; i < _n; i++)
+        converged[i] = false;
+
+    for (int iteration = 0; iteration < maxIterations; iteration++)
+    {
+        bool all = true;
+
+        for (int i = 0; i < _n; i++)
+        {
+            if (converged[i])
+                continue;
+
+            float h = step(_y[i]);
+            float value = g(_x[i], _y[i]);
+            float gy = (g(_x[i], _y[i] + h) - g(_x[i], _y[i] - h)) / (2 * h);
+            float delta = value / gy;
+
+            if (!std::isfinite(delta))
+                return false;
+
+            _y[i] -= delta;
+            converged[i] = fabsf(delta) <= tolerance * (1 + fabsf(_y[i]));
+            all &= converged[i];
+        }
+
+        if (all)
+            return true;
+    }
+
+    return false;
+}
+
+#endif //IMPLICIT_PIECEWISE_H
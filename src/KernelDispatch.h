@@ -0,0 +1,296 @@
+// File: KernelDispatch.h
+// Author: David Antaki
+// Date: 10/18/2026
+// License: Closed source
+//
+// Contents: Picks the batch lookup and build kernels of BatchLookup.h for
+// the CPU the program runs on. On x86 hosts built with GCC or Clang the
+// kernels are compiled once per instruction set (generic, SSE4.2, AVX2 and
+// AVX-512) and the best one the CPU supports is selected from CPUID the
+// first time a kernel is needed, so one binary runs its best kernel on
+// every server. select() pins a variant instead, e.g. for benchmarks. The
+// selection is an atomic variable, so select() may run while other threads
+// look up kernels; they switch to the new variant with their next call. On
+// other targets only the generic kernels exist. Multiply-adds are never
+// fused into FMA instructions, not even in the generic kernel on an FMA
+// baseline (see PIECEWISE_NO_CONTRACT_BEGIN in BatchLookup.h), so every
+// variant returns exactly what the generic kernel and xToy() return.
+
+#ifndef KERNEL_DISPATCH_H
+#define KERNEL_DISPATCH_H
+
+#include <stddef.h>
+#include <atomic>
+#include "mbed.h"
+#include "BatchLookup.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define KERNEL_DISPATCH_X86
+#define KERNEL_DISPATCH_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+PIECEWISE_NO_CONTRACT_BEGIN
+
+enum KernelVariant
+{
+    KERNEL_AUTO,
+    KERNEL_GENERIC,
+    KERNEL_SSE42,
+    KERNEL_AVX2,
+    KERNEL_AVX512
+};
+
+template <class Segment>
+class KernelDispatch
+{
+public:
+    typedef void (*LookupKernel)(const float *_breaks, const Segment *_segments, size_t _nSegments, float _sign,
+                                 float _preGain, float _preOffset, float _postGain, float _postOffset,
+                                 const float *_in, size_t _inStride, float *_out, size_t _outStride, size_t _n,
+                                 float *_slopes);
+    typedef void (*BuildKernel)(const float *_knotXs, const float *_knotYs,
+                                Segment *_xSegments, Segment *_ySegments, size_t _nSegments);
+
+    // Pins the kernels to one variant, or detects the best with KERNEL_AUTO
+    //
+    // @param _variant  The variant, must be supported by the CPU
+    static void select(KernelVariant _variant);
+
+    // @return  The variant in use
+    static KernelVariant selected();
+
+    // @param _variant  A variant
+    // @return          True if it is compiled in and the CPU supports it
+    static bool isSupported(KernelVariant _variant);
+
+    // @param _variant  A variant
+    // @return          Its name for reports
+    static const char *name(KernelVariant _variant);
+
+    // @return  The batch lookup kernel of the selected variant, see
+    //          BatchLookup::runAffine()
+    static LookupKernel lookup();
+
+    // @return  The segment build kernel of the selected variant
+    static BuildKernel build();
+
+private:
+    typedef struct
+    {
+        KernelVariant variant;
+        LookupKernel lookup;
+        BuildKernel build;
+    } Kernels;
+
+    // @return  The selected variant, detected the first time it is needed
+    static std::atomic<KernelVariant> &current();
+
+    // @return  The best supported variant
+    static KernelVariant detect();
+
+    // @return  The kernels of a variant
+    static Kernels kernelsOf(KernelVariant _variant);
+
+    static void lookupGeneric(const float *_breaks, const Segment *_segments, size_t _nSegments, float _sign,
+                              float _preGain, float _preOffset, float _postGain, float _postOffset,
+                              const float *_in, size_t _inStride, float *_out, size_t _outStride, size_t _n,
+                              float *_slopes)
+    {
+        BatchLookup::runAffine(_breaks, _segments, _nSegments, _sign, _preGain, _preOffset, _postGain, _postOffset,
+                               _in, _inStride, _out, _outStride, _n, _slopes);
+    }
+
+    static void buildGeneric(const float *_knotXs, const float *_knotYs,
+                             Segment *_xSegments, Segment *_ySegments, size_t _nSegments)
+    {
+        BatchLookup::buildSegments(_knotXs, _knotYs, _xSegments, _ySegments, _nSegments);
+    }
+
+#ifdef KERNEL_DISPATCH_X86
+    KERNEL_DISPATCH_TARGET("sse4.2")
+    static void lookupSse42(const float *_breaks, const Segment *_segments, size_t _nSegments, float _sign,
+                            float _preGain, float _preOffset, float _postGain, float _postOffset,
+                            const float *_in, size_t _inStride, float *_out, size_t _outStride, size_t _n,
+                            float *_slopes)
+    {
+        BatchLookup::runAffine(_breaks, _segments, _nSegments, _sign, _preGain, _preOffset, _postGain, _postOffset,
+                               _in, _inStride, _out, _outStride, _n, _slopes);
+    }
+
+    KERNEL_DISPATCH_TARGET("sse4.2")
+    static void buildSse42(const float *_knotXs, const float *_knotYs,
+                           Segment *_xSegments, Segment *_ySegments, size_t _nSegments)
+    {
+        BatchLookup::buildSegments(_knotXs, _knotYs, _xSegments, _ySegments, _nSegments);
+    }
+
+    KERNEL_DISPATCH_TARGET("avx2")
+    static void lookupAvx2(const float *_breaks, const Segment *_segments, size_t _nSegments, float _sign,
+                           float _preGain, float _preOffset, float _postGain, float _postOffset,
+                           const float *_in, size_t _inStride, float *_out, size_t _outStride, size_t _n,
+                           float *_slopes)
+    {
+        BatchLookup::runAffine(_breaks, _segments, _nSegments, _sign, _preGain, _preOffset, _postGain, _postOffset,
+                               _in, _inStride, _out, _outStride, _n, _slopes);
+    }
+
+    KERNEL_DISPATCH_TARGET("avx2")
+    static void buildAvx2(const float *_knotXs, const float *_knotYs,
+                          Segment *_xSegments, Segment *_ySegments, size_t _nSegments)
+    {
+        BatchLookup::buildSegments(_knotXs, _knotYs, _xSegments, _ySegments, _nSegments);
+    }
+
+    KERNEL_DISPATCH_TARGET("avx512f,avx2")
+    static void lookupAvx512(const float *_breaks, const Segment *_segments, size_t _nSegments, float _sign,
+                             float _preGain, float _preOffset, float _postGain, float _postOffset,
+                             const float *_in, size_t _inStride, float *_out, size_t _outStride, size_t _n,
+                             float *_slopes)
+    {
+        BatchLookup::runAffine(_breaks, _segments, _nSegments, _sign, _preGain, _preOffset, _postGain, _postOffset,
+                               _in, _inStride, _out, _outStride, _n, _slopes);
+    }
+
+    KERNEL_DISPATCH_TARGET("avx512f,avx2")
+    static void buildAvx512(const float *_knotXs, const float *_knotYs,
+                            Segment *_xSegments, Segment *_ySegments, size_t _nSegments)
+    {
+        BatchLookup::buildSegments(_knotXs, _knotYs, _xSegments, _ySegments, _nSegments);
+    }
+#endif
+};
+
+template <class Segment>
+void KernelDispatch<Segment>::select(KernelVariant _variant)
+{
+    if (_variant == KERNEL_AUTO)
+        _variant = detect();
+
+    if (!isSupported(_variant))
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_UNSUPPORTED), "Kernel variant is not supported by this CPU or build");
+    }
+
+    current().store(kernelsOf(_variant).variant, std::memory_order_relaxed);
+}
+
+template <class Segment>
+KernelVariant KernelDispatch<Segment>::selected()
+{
+    return current().load(std::memory_order_relaxed);
+}
+
+template <class Segment>
+bool KernelDispatch<Segment>::isSupported(KernelVariant _variant)
+{
+    switch (_variant)
+    {
+    case KERNEL_AUTO:
+    case KERNEL_GENERIC:
+        return true;
+#ifdef KERNEL_DISPATCH_X86
+    case KERNEL_SSE42:
+        return __builtin_cpu_supports("sse4.2");
+    case KERNEL_AVX2:
+        return __builtin_cpu_supports("avx2");
+    case KERNEL_AVX512:
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+template <class Segment>
+const char *KernelDispatch<Segment>::name(KernelVariant _variant)
+{
+    switch (_variant)
+    {
+    case KERNEL_AUTO:
+        return "auto";
+    case KERNEL_SSE42:
+        return "sse4.2";
+    case KERNEL_AVX2:
+        return "avx2";
+    case KERNEL_AVX512:
+        return "avx512";
+    case KERNEL_GENERIC:
+    default:
+        return "generic";
+    }
+}
+
+template <class Segment>
+typename KernelDispatch<Segment>::LookupKernel KernelDispatch<Segment>::lookup()
+{
+    return kernelsOf(current().load(std::memory_order_relaxed)).lookup;
+}
+
+template <class Segment>
+typename KernelDispatch<Segment>::BuildKernel KernelDispatch<Segment>::build()
+{
+    return kernelsOf(current().load(std::memory_order_relaxed)).build;
+}
+
+template <class Segment>
+std::atomic<KernelVariant> &KernelDispatch<Segment>::current()
+{
+    // Detected once, the first time a kernel is needed. The kernels are
+    // plain functions, so relaxed loads and stores of the variant suffice.
+    static std::atomic<KernelVariant> variant(kernelsOf(detect()).variant);
+    return variant;
+}
+
+template <class Segment>
+KernelVariant KernelDispatch<Segment>::detect()
+{
+#ifdef KERNEL_DISPATCH_X86
+    __builtin_cpu_init();
+
+    if (isSupported(KERNEL_AVX512))
+        return KERNEL_AVX512;
+    if (isSupported(KERNEL_AVX2))
+        return KERNEL_AVX2;
+    if (isSupported(KERNEL_SSE42))
+        return KERNEL_SSE42;
+#endif
+    return KERNEL_GENERIC;
+}
+
+template <class Segment>
+typename KernelDispatch<Segment>::Kernels KernelDispatch<Segment>::kernelsOf(KernelVariant _variant)
+{
+    Kernels kernels;
+    kernels.variant = KERNEL_GENERIC;
+    kernels.lookup = lookupGeneric;
+    kernels.build = buildGeneric;
+
+#ifdef KERNEL_DISPATCH_X86
+    switch (_variant)
+    {
+    case KERNEL_SSE42:
+        kernels.variant = KERNEL_SSE42;
+        kernels.lookup = lookupSse42;
+        kernels.build = buildSse42;
+        break;
+    case KERNEL_AVX2:
+        kernels.variant = KERNEL_AVX2;
+        kernels.lookup = lookupAvx2;
+        kernels.build = buildAvx2;
+        break;
+    case KERNEL_AVX512:
+        kernels.variant = KERNEL_AVX512;
+        kernels.lookup = lookupAvx512;
+        kernels.build = buildAvx512;
+        break;
+    default:
+        break;
+    }
+#endif
+
+    return kernels;
+}
+
+PIECEWISE_NO_CONTRACT_END
+
+#endif //KERNEL_DISPATCH_H
@@ -0,0 +1,313 @@
+// File: LearnedIndexPiecewise.h
+// Author: David Antaki
+// Date: 10/18/2026
+// License: Closed source
+//
+// Contents: Lookup engine for piecewise functions with unevenly spaced
+// knots, e.g. adaptive tables whose knots follow a smooth density.
+// Instead of a binary search over all knots, a tiny two-level model of the
+// knots' cumulative distribution predicts the segment: a root linear model
+// picks one of a few leaf linear models, and the leaf predicts the segment
+// index. At build time the largest prediction error of every leaf is
+// measured, so a lookup only searches the few segments inside that error
+// window. Queries that land outside of it (possible right at a leaf
+// boundary) fall back to a binary search over all knots. The segments
+// themselves are the table's own flat segments, shared with a copy of the
+// piecewise function, so the results match the batch kernels exactly.
+
+#ifndef LEARNED_INDEX_PIECEWISE_H
+#define LEARNED_INDEX_PIECEWISE_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include "mbed.h"
+#include "FunctionToPiecewise.h"
+
+// Two-level recursive model index over ascending keys
+PIECEWISE_NO_CONTRACT_BEGIN
+
+class LearnedIndex
+{
+public:
+    LearnedIndex();
+
+    // @param _keys     The ascending keys
+    // @param _nKeys    The number of keys, at least 2
+    // @param _nLeaves  The number of leaf models
+    void build(const float *_keys, size_t _nKeys, size_t _nLeaves);
+
+    // Returns the index i of the last key <= _key, with the last key
+    // counting as part of the segment before it, so i is in [0, nKeys - 2]
+    //
+    // @param _key  The key, between the first and the last key
+    // @return      The segment index
+    size_t find(float _key) const;
+
+    // @return  The widest error window of all leaves
+    size_t getMaxWindow() const;
+
+private:
+    typedef struct
+    {
+        float slope;
+        float intercept;
+        // The segment index is within [prediction + errorLow,
+        // prediction + errorHigh] for all keys routed to this leaf
+        int errorLow;
+        int errorHigh;
+    } Model;
+
+    std::vector<float> keys;
+    Model root;
+    std::vector<Model> leaves;
+
+    // @return  The leaf a key is routed to
+    size_t leafOf(float _key) const;
+
+    // @return  The model's prediction for a key
+    static float predict(const Model &_model, float _key);
+};
+
+class LearnedIndexPiecewise
+{
+public:
+    // @param _piecewise    The piecewise function to look up
+    // @param _nLeaves      The number of leaf models, more leaves fit the
+    //                      knot density more closely. 0 uses one leaf
+    //                      per 8 knots.
+    LearnedIndexPiecewise(const FunctionToPiecewise &_piecewise, size_t _nLeaves = 0);
+
+    // Takes an x value and returns y, like FunctionToPiecewise::xToy().
+    // The end of the interval is included.
+    float xToy(float _x) const;
+
+    // Takes a y value and returns x, like FunctionToPiecewise::yTox().
+    // Only for monotonic functions.
+    float yTox(float _y) const;
+
+    // @return  The widest error window of the x index
+    size_t getMaxWindow() const;
+
+private:
+    // Shares the table, and its flat segments, with the original
+    FunctionToPiecewise piecewise;
+
+    LearnedIndex xIndex;
+    LearnedIndex yIndex;
+
+    // 1 if the function rises, -1 if it falls, 0 if it is not monotonic
+    float ySign;
+    float xFirst, xLast;
+    float yKeyFirst, yKeyLast;
+};
+
+LearnedIndex::LearnedIndex()
+{
+    root.slope = root.intercept = 0;
+    root.errorLow = root.errorHigh = 0;
+}
+
+void LearnedIndex::build(const float *_keys, size_t _nKeys, size_t _nLeaves)
+{
+    if (_nKeys < 2 || _nLeaves < 1)
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "A learned index needs at least 2 keys and 1 leaf");
+    }
+
+    keys.assign(_keys, _keys + _nKeys);
+    size_t nSegments = _nKeys - 1;
+
+    // The root is a least squares fit of the leaf each key should go to
+    // if all leaves held the same number of keys, i.e. of the keys' CDF
+    double n0 = 0, sx0 = 0, sy0 = 0, sxx0 = 0, sxy0 = 0;
+    for (size_t i = 0; i < _nKeys; i++)
+    {
+        double x = keys[i];
+        double y = (double)i * _nLeaves / _nKeys;
+        n0++;
+        sx0 += x;
+        sy0 += y;
+        sxx0 += x * x;
+        sxy0 += x * y;
+    }
+    double rootDenominator = n0 * sxx0 - sx0 * sx0;
+    root.slope = (rootDenominator > 0) ? (n0 * sxy0 - sx0 * sy0) / rootDenominator : 0;
+    root.intercept = (sy0 - root.slope * sx0) / n0;
+
+    leaves.assign(_nLeaves, root);
+
+    // Least squares fit of segment index over key for every leaf
+    std::vector<double> n(_nLeaves, 0), sx(_nLeaves, 0), sy(_nLeaves, 0), sxx(_nLeaves, 0), sxy(_nLeaves, 0);
+    for (size_t i = 0; i < _nKeys; i++)
+    {
+        size_t leaf = leafOf(keys[i]);
+        double x = keys[i];
+        double y = std::min(i, nSegments - 1);
+        n[leaf]++;
+        sx[leaf] += x;
+        sy[leaf] += y;
+        sxx[leaf] += x * x;
+        sxy[leaf] += x * y;
+    }
+
+    for (size_t leaf = 0; leaf < _nLeaves; leaf++)
+    {
+        Model &model = leaves[leaf];
+        double denominator = n[leaf] * sxx[leaf] - sx[leaf] * sx[leaf];
+
+        if (n[leaf] >= 2 && fabs(denominator) > 1e-12 * n[leaf] * sxx[leaf])
+        {
+            model.slope = (n[leaf] * sxy[leaf] - sx[leaf] * sy[leaf]) / denominator;
+            model.intercept = (sy[leaf] - model.slope * sx[leaf]) / n[leaf];
+        }
+        else
+        {
+            // Empty or single key leaf: predict the nearest key's segment
+            model.slope = 0;
+            model.intercept = (n[leaf] > 0) ? sy[leaf] / n[leaf] : 0;
+        }
+
+        model.errorLow = 0;
+        model.errorHigh = 0;
+    }
+
+    // Measure the error window. A query between key i and key i+1 in the
+    // same leaf is predicted between their predictions, so its segment i
+    // is within [error(i+1) - 1, error(i)].
+    for (size_t i = 0; i < _nKeys; i++)
+    {
+        Model &model = leaves[leafOf(keys[i])];
+        float prediction = predict(model, keys[i]);
+        int low = (int)floorf(std::min(i, nSegments) - prediction) - 1;
+        int high = (int)ceilf(std::min(i, nSegments - 1) - prediction);
+
+        model.errorLow = std::min(model.errorLow, low);
+        model.errorHigh = std::max(model.errorHigh, high);
+    }
+}
+
+size_t LearnedIndex::find(float _key) const
+{
+    size_t nSegments = keys.size() - 1;
+    const Model &model = leaves[leafOf(_key)];
+    float prediction = predict(model, _key);
+
+    // Binary search inside the error window
+    long low = (long)floorf(prediction) + model.errorLow;
+    long high = (long)ceilf(prediction) + model.errorHigh;
+    low = std::max(0L, std::min(low, (long)nSegments - 1));
+    high = std::max(0L, std::min(high, (long)nSegments - 1));
+
+    const float *begin = keys.data() + low;
+    const float *end = keys.data() + high + 1;
+    size_t i = (std::upper_bound(begin, end, _key) - keys.data());
+    i = (i > 0) ? i - 1 : 0;
+
+    // Outside of the window, e.g. right at a leaf boundary: search outwards
+    if (keys[i] > _key || (i + 1 < nSegments && keys[i + 1] <= _key))
+    {
+        i = std::upper_bound(keys.begin(), keys.begin() + nSegments, _key) - keys.begin();
+        i = (i > 0) ? i - 1 : 0;
+    }
+
+    return i;
+}
+
+size_t LearnedIndex::getMaxWindow() const
+{
+    size_t window = 0;
+    for (size_t i = 0; i < leaves.size(); i++)
+        window = std::max(window, (size_t)(leaves[i].errorHigh - leaves[i].errorLow + 1));
+    return window;
+}
+
+size_t LearnedIndex::leafOf(float _key) const
+{
+    float leaf = predict(root, _key);
+    if (!(leaf >= 0))
+        return 0;
+    if (leaf >= leaves.size())
+        return leaves.size() - 1;
+    return (size_t)leaf;
+}
+
+float LearnedIndex::predict(const Model &_model, float _key)
+{
+    return _model.slope * _key + _model.intercept;
+}
+
+LearnedIndexPiecewise::LearnedIndexPiecewise(const FunctionToPiecewise &_piecewise, size_t _nLeaves)
+    : piecewise(_piecewise)
+{
+    const std::vector<FunctionToPiecewise::Point> &knots = piecewise.getKnots();
+    size_t nKnots = knots.size();
+
+    if (_nLeaves == 0)
+        _nLeaves = std::max((size_t)1, nKnots / 8);
+
+    std::vector<float> xKeys(nKnots);
+    std::vector<float> yKeys(nKnots);
+    bool rising = false;
+    bool falling = false;
+
+    for (size_t i = 0; i < nKnots; i++)
+    {
+        xKeys[i] = knots[i].x;
+
+        if (i + 1 < nKnots)
+        {
+            rising |= knots[i + 1].y > knots[i].y;
+            falling |= knots[i + 1].y < knots[i].y;
+        }
+    }
+
+    xIndex.build(xKeys.data(), nKnots, _nLeaves);
+    xFirst = xKeys.front();
+    xLast = xKeys.back();
+
+    // The y index needs ascending keys, so it indexes sign * y
+    ySign = (rising && falling) ? 0 : (falling ? -1 : 1);
+    if (ySign != 0)
+    {
+        for (size_t i = 0; i < nKnots; i++)
+            yKeys[i] = ySign * knots[i].y;
+
+        yIndex.build(yKeys.data(), nKnots, _nLeaves);
+        yKeyFirst = yKeys.front();
+        yKeyLast = yKeys.back();
+    }
+}
+
+float LearnedIndexPiecewise::xToy(float _x) const
+{
+    if (!(_x >= xFirst && _x <= xLast))
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "_x value is out of the piecewise function's interval");
+    }
+
+    const FunctionToPiecewise::LineFunc &segment = piecewise.getXSegments()[xIndex.find(_x)];
+    return (segment.slope * _x) + segment.yint;
+}
+
+float LearnedIndexPiecewise::yTox(float _y) const
+{
+    float key = ySign * _y;
+
+    if (ySign == 0 || !(key >= yKeyFirst && key <= yKeyLast))
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "_y value is out of the piecewise function's range or it is not monotonic");
+    }
+
+    const FunctionToPiecewise::LineFunc &segment = piecewise.getYSegments()[yIndex.find(key)];
+    return (segment.slope * _y) + segment.yint;
+}
+
+size_t LearnedIndexPiecewise::getMaxWindow() const
+{
+    return xIndex.getMaxWindow();
+}
+
+PIECEWISE_NO_CONTRACT_END
+
+#endif //LEARNED_INDEX_PIECEWISE_H
@@ -0,0 +1,126 @@
+// File: NestedGridSampler.h
+// Author: David Antaki
+// Date: 10/18/2026
+// License: Closed source
+//
+// Contents: Builds piecewise functions of a function at power-of-two
+// refinements of a base grid while sampling the function only once per
+// grid point. Every level's knots are a subset of the finest level's knots,
+// so the samples are cached on the finest grid and a finer level only
+// evaluates the midpoints the coarser levels did not need. Sweeping all
+// levels to pick a table size costs about as much as building the finest
+// level once.
+
+#ifndef NESTED_GRID_SAMPLER_H
+#define NESTED_GRID_SAMPLER_H
+
+#include <vector>
+#include "mbed.h"
+#include "FunctionToPiecewise.h"
+
+class NestedGridSampler
+{
+public:
+    // @param float (*function)(float)  The function to sample
+    // @param _baseSegments     The number of segments at level 0
+    // @param _interval         The interval of the piecewise functions
+    // @param _maxLevel         The finest level. Level l has
+    //                          _baseSegments * 2^l segments.
+    NestedGridSampler(float (*function)(float), int _baseSegments,
+                      std::pair<float, float> _interval, int _maxLevel);
+
+    // Returns the knots of one level, sampling only the grid points that
+    // no earlier call has sampled yet.
+    //
+    // @param _level    The level, 0 to _maxLevel
+    // @return          The knots sorted by ascending x
+    std::vector<FunctionToPiecewise::Point> getKnots(int _level);
+
+    // Builds the piecewise function of one level.
+    //
+    // @param _level    The level, 0 to _maxLevel
+    // @return          The piecewise function with
+    //                  _baseSegments * 2^_level segments
+    FunctionToPiecewise build(int _level);
+
+    // @return  How many times the function has been evaluated so far
+    size_t getEvaluations() const;
+
+private:
+    float (*originalFunction)(float);
+    int baseSegments;
+    std::pair<float, float> interval;
+    int maxLevel;
+
+    // The number of segments of the finest level
+    int nFinestSegments;
+
+    // The cached samples on the finest grid and which of them are valid
+    std::vector<float> samples;
+    std::vector<bool> sampled;
+
+    size_t nEvaluations;
+};
+
+NestedGridSampler::NestedGridSampler(float (*function)(float), int _baseSegments,
+                                     std::pair<float, float> _interval, int _maxLevel)
+{
+    if (_baseSegments < 1 || _maxLevel < 0 || _maxLevel > 24 || !(_interval.second > _interval.first))
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "Invalid base segments, level or interval for the nested grid");
+    }
+
+    originalFunction = function;
+    baseSegments = _baseSegments;
+    interval = _interval;
+    maxLevel = _maxLevel;
+    nFinestSegments = _baseSegments << _maxLevel;
+    nEvaluations = 0;
+
+    samples.assign(nFinestSegments + 1, 0);
+    sampled.assign(nFinestSegments + 1, false);
+}
+
+std::vector<FunctionToPiecewise::Point> NestedGridSampler::getKnots(int _level)
+{
+    if (_level < 0 || _level > maxLevel)
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "Level is out of the nested grid's range");
+    }
+
+    // Distance between this level's knots in units of finest grid points
+    int stride = 1 << (maxLevel - _level);
+    int nSegments = baseSegments << _level;
+
+    std::vector<FunctionToPiecewise::Point> knots(nSegments + 1);
+    for (int k = 0; k <= nSegments; k++)
+    {
+        int i = k * stride;
+
+        // x is computed from the finest grid index so that every level
+        // uses exactly the same x for a shared grid point
+        knots[k].x = interval.first + (interval.second - interval.first) * ((float)i / nFinestSegments);
+
+        if (!sampled[i])
+        {
+            samples[i] = (*originalFunction)(knots[k].x);
+            sampled[i] = true;
+            nEvaluations++;
+        }
+        knots[k].y = samples[i];
+    }
+
+    return knots;
+}
+
+FunctionToPiecewise NestedGridSampler::build(int _level)
+{
+    return FunctionToPiecewise(getKnots(_level));
+}
+
+size_t NestedGridSampler::getEvaluations() const
+{
+    return nEvaluations;
+}
+
+#endif //NESTED_GRID_SAMPLER_H
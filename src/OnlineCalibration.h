@@ -0,0 +1,148 @@
+// File: OnlineCalibration.h
+// Author: David Antaki
+// Date: 10/18/2026
+// License: Closed source
+//
+// Contents: Adapts the knots of a FunctionToPiecewise in the field whenever
+// a trusted reference is available, e.g. a known distance for a measured
+// flux density. Every update is a diagonal recursive least squares step on
+// the two knots of the segment the reference falls in. setKnotY() only
+// rewrites those knots and the flat segments next to them in place, so on
+// evenly spaced knots an update is O(1); otherwise finding the segment
+// costs O(log n). The exception is a table shared with copies of the
+// FunctionToPiecewise: the first update deep-copies the whole table, O(n)
+// with an allocation, and only later updates are in place. Build the
+// copies after calibrating, or update the only instance, in real-time
+// code.
+
+#ifndef ONLINE_CALIBRATION_H
+#define ONLINE_CALIBRATION_H
+
+#include <vector>
+#include <algorithm>
+#include "mbed.h"
+#include "FunctionToPiecewise.h"
+
+class OnlineCalibration
+{
+public:
+    // @param _piecewise    The piecewise function to adapt. It must outlive
+    //                      this object.
+    // @param _forgetting   RLS forgetting factor in (0, 1]. Smaller values
+    //                      adapt faster and forget older references sooner.
+    // @param _maxStep      The most a single update may move a knot's y-value.
+    // @param _initialVariance  How uncertain the initial knot values are.
+    OnlineCalibration(FunctionToPiecewise *_piecewise, float _forgetting = 0.99,
+                      float _maxStep = 1.0, float _initialVariance = 1.0);
+
+    // Nudges the knots around _x so the piecewise function moves towards
+    // the reference point.
+    //
+    // @param _x    The reference x value, e.g. the known distance
+    // @param _y    The y value measured at _x, e.g. the flux density
+    void update(float _x, float _y);
+
+private:
+    FunctionToPiecewise *piecewise;
+    float forgetting;
+    float maxStep;
+    float initialVariance;
+
+    // The variance of every knot, the diagonal of the RLS covariance
+    std::vector<float> variance;
+
+    // If the knots are evenly spaced, the segment of a reference is found
+    // directly instead of by binary search.
+    bool evenlySpaced;
+    float xIncrement;
+
+    // Returns the index of the segment that holds _x
+    //
+    // @param _x    The x value
+    // @return      The index of the left knot of the segment
+    size_t findSegment(float _x);
+};
+
+OnlineCalibration::OnlineCalibration(FunctionToPiecewise *_piecewise, float _forgetting,
+                                     float _maxStep, float _initialVariance)
+{
+    piecewise = _piecewise;
+    forgetting = _forgetting;
+    maxStep = _maxStep;
+    initialVariance = _initialVariance;
+
+    const std::vector<FunctionToPiecewise::Point> &knots = piecewise->getKnots();
+    variance.assign(knots.size(), _initialVariance);
+
+    xIncrement = (knots.back().x - knots.front().x) / (knots.size() - 1);
+    evenlySpaced = true;
+    for (size_t i = 0; i < knots.size(); i++)
+    {
+        float expected = knots.front().x + i * xIncrement;
+        if (fabs(knots[i].x - expected) > 1e-3f * xIncrement)
+            evenlySpaced = false;
+    }
+}
+
+void OnlineCalibration::update(float _x, float _y)
+{
+    const std::vector<FunctionToPiecewise::Point> &knots = piecewise->getKnots();
+
+    if (_x < knots.front().x || _x > knots.back().x)
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "_x value is out of the piecewise function's interval");
+    }
+
+    size_t k = findSegment(_x);
+    FunctionToPiecewise::Point left = knots[k];
+    FunctionToPiecewise::Point right = knots[k + 1];
+
+    // Hat basis weights of the two knots. The even grid may pick the
+    // neighbouring segment right at a knot, so keep them inside it.
+    float w1 = std::max(0.0f, std::min(1.0f, (_x - left.x) / (right.x - left.x)));
+    float w0 = 1 - w1;
+
+    float error = _y - (w0 * left.y + w1 * right.y);
+
+    // Diagonal RLS gain for both knots
+    float denominator = forgetting + variance[k] * w0 * w0 + variance[k + 1] * w1 * w1;
+    float gain0 = variance[k] * w0 / denominator;
+    float gain1 = variance[k + 1] * w1 / denominator;
+
+    float step0 = std::max(-maxStep, std::min(maxStep, gain0 * error));
+    float step1 = std::max(-maxStep, std::min(maxStep, gain1 * error));
+
+    // Keep the variance bounded so the estimator never stops adapting
+    variance[k] = std::min(initialVariance, (variance[k] - gain0 * w0 * variance[k]) / forgetting);
+    variance[k + 1] = std::min(initialVariance, (variance[k + 1] - gain1 * w1 * variance[k + 1]) / forgetting);
+
+    piecewise->setKnotY(k, left.y + step0);
+    piecewise->setKnotY(k + 1, right.y + step1);
+}
+
+size_t OnlineCalibration::findSegment(float _x)
+{
+    const std::vector<FunctionToPiecewise::Point> &knots = piecewise->getKnots();
+    size_t k;
+
+    if (evenlySpaced)
+    {
+        k = (size_t)((_x - knots.front().x) / xIncrement);
+    }
+    else
+    {
+        auto iter = std::upper_bound(knots.begin(), knots.end(), _x,
+                                     [](float x, const FunctionToPiecewise::Point &pt) {
+                                         return x < pt.x;
+                                     });
+        k = (iter - knots.begin()) - 1;
+    }
+
+    // _x at the very end of the interval belongs to the last segment
+    if (k >= knots.size() - 1)
+        k = knots.size() - 2;
+
+    return k;
+}
+
+#endif //ONLINE_CALIBRATION_H
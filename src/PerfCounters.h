@@ -0,0 +1,211 @@
+// File: PerfCounters.h
+// Author: David Antaki
+// Date: 10/18/2026
+// License: Closed source
+//
+// Contents: Reads hardware performance counters around a benchmark on
+// Linux hosts with perf_event_open: cycles, instructions, branch misses,
+// L1 data cache misses, last level cache misses and data TLB misses. Every
+// counter is opened on its own, so counters the CPU, kernel or container
+// does not allow are simply reported as unavailable. On other platforms
+// all counters are unavailable.
+//
+// When there are more counters than the PMU has registers the kernel
+// multiplexes them, and each one only counts part of the time. The count
+// is then scaled up by the time it was enabled over the time it was
+// running, and isScaled() reports that it is an estimate.
+
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <stdint.h>
+#include "mbed.h"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+class PerfCounters
+{
+public:
+    enum Counter
+    {
+        CYCLES,
+        INSTRUCTIONS,
+        BRANCH_MISSES,
+        L1D_MISSES,
+        LLC_MISSES,
+        DTLB_MISSES,
+        N_COUNTERS
+    };
+
+    PerfCounters();
+    virtual ~PerfCounters();
+
+    // Owns the file descriptors of the counters
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    // Resets and starts all available counters
+    void start();
+
+    // Stops all counters
+    void stop();
+
+    // @param _counter  The counter
+    // @return          True if the counter could be opened
+    bool isAvailable(Counter _counter) const;
+
+    // @param _counter  The counter
+    // @return          The count between start() and stop(), scaled if
+    //                  the counter was multiplexed. 0 if the counter is
+    //                  unavailable or never ran.
+    uint64_t read(Counter _counter) const;
+
+    // @param _counter  The counter
+    // @return          True if the counter was multiplexed with others, so
+    //                  read() is scaled from part of the time
+    bool isScaled(Counter _counter) const;
+
+    // @param _counter  The counter
+    // @return          The name of the counter
+    static const char *name(Counter _counter);
+
+private:
+    // File descriptor of every counter, -1 if unavailable
+    int fds[N_COUNTERS];
+
+    // Opens one counter
+    //
+    // @param _type     The perf event type
+    // @param _config   The perf event config
+    // @return          The file descriptor or -1
+    static int open(uint32_t _type, uint64_t _config);
+
+    // Reads one counter with its enabled and running times
+    //
+    // @param _counter  The counter
+    // @param _values   Receives the count, the time enabled and the time
+    //                  running
+    // @return          True on success
+    bool readValues(Counter _counter, uint64_t _values[3]) const;
+};
+
+PerfCounters::PerfCounters()
+{
+#if defined(__linux__)
+    fds[CYCLES] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    fds[INSTRUCTIONS] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    fds[BRANCH_MISSES] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    fds[L1D_MISSES] = open(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                                   (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    fds[LLC_MISSES] = open(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                                   (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    fds[DTLB_MISSES] = open(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                                    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+#else
+    for (int i = 0; i < N_COUNTERS; i++)
+        fds[i] = -1;
+#endif
+}
+
+PerfCounters::~PerfCounters()
+{
+#if defined(__linux__)
+    for (int i = 0; i < N_COUNTERS; i++)
+    {
+        if (fds[i] >= 0)
+            close(fds[i]);
+    }
+#endif
+}
+
+void PerfCounters::start()
+{
+#if defined(__linux__)
+    for (int i = 0; i < N_COUNTERS; i++)
+    {
+        if (fds[i] >= 0)
+        {
+            ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+}
+
+void PerfCounters::stop()
+{
+#if defined(__linux__)
+    for (int i = 0; i < N_COUNTERS; i++)
+    {
+        if (fds[i] >= 0)
+            ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+    }
+#endif
+}
+
+bool PerfCounters::isAvailable(Counter _counter) const
+{
+    return fds[_counter] >= 0;
+}
+
+uint64_t PerfCounters::read(Counter _counter) const
+{
+    uint64_t values[3];
+
+    if (!readValues(_counter, values) || values[2] == 0)
+        return 0;
+
+    if (values[2] < values[1])
+        return (uint64_t)((double)values[0] * values[1] / values[2]);
+    return values[0];
+}
+
+bool PerfCounters::isScaled(Counter _counter) const
+{
+    uint64_t values[3];
+    return readValues(_counter, values) && values[2] < values[1];
+}
+
+const char *PerfCounters::name(Counter _counter)
+{
+    static const char *names[N_COUNTERS] = {"cycles", "instructions", "branch-misses",
+                                            "L1d-misses", "LLC-misses", "dTLB-misses"};
+    return names[_counter];
+}
+
+int PerfCounters::open(uint32_t _type, uint64_t _config)
+{
+#if defined(__linux__)
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = _type;
+    attr.config = _config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    // This thread on any CPU
+    return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+bool PerfCounters::readValues(Counter _counter, uint64_t _values[3]) const
+{
+#if defined(__linux__)
+    return fds[_counter] >= 0 && ::read(fds[_counter], _values, 3 * sizeof(uint64_t)) == 3 * sizeof(uint64_t);
+#else
+    return false;
+#endif
+}
+
+#endif //PERF_COUNTERS_H
@@ -0,0 +1,244 @@
+// File: PiecewiseArithmetic.h
+// Author: David Antaki
+// Date: 10/18/2026
+// License: Closed source
+//
+// Contents: Pointwise arithmetic on piecewise functions, e.g. superposing
+// the fields of two magnets into one piecewise function so only one table
+// is evaluated per sample. The knots of both operands are merged in linear
+// time over the interval where both are defined. Sums, differences and
+// affine maps are exact on the merged knots, min/max add a knot where the
+// operands cross and products are re-segmented until every segment is
+// within a tolerance of the exact (quadratic) product.
+
+#ifndef PIECEWISE_ARITHMETIC_H
+#define PIECEWISE_ARITHMETIC_H
+
+#include <vector>
+#include <cmath>
+#include "mbed.h"
+#include "FunctionToPiecewise.h"
+
+class PiecewiseArithmetic
+{
+public:
+    // @return  _a(x) + _b(x)
+    static FunctionToPiecewise add(const FunctionToPiecewise &_a, const FunctionToPiecewise &_b);
+
+    // @return  _a(x) - _b(x)
+    static FunctionToPiecewise subtract(const FunctionToPiecewise &_a, const FunctionToPiecewise &_b);
+
+    // @param _tolerance    The largest allowed difference between the
+    //                      returned piecewise function and the exact product
+    // @return              _a(x) * _b(x)
+    static FunctionToPiecewise multiply(const FunctionToPiecewise &_a, const FunctionToPiecewise &_b, float _tolerance);
+
+    // @return  min(_a(x), _b(x))
+    static FunctionToPiecewise min(const FunctionToPiecewise &_a, const FunctionToPiecewise &_b);
+
+    // @return  max(_a(x), _b(x))
+    static FunctionToPiecewise max(const FunctionToPiecewise &_a, const FunctionToPiecewise &_b);
+
+    // @return  _gain * _a(x) + _offset
+    static FunctionToPiecewise affine(const FunctionToPiecewise &_a, float _gain, float _offset);
+
+private:
+    typedef FunctionToPiecewise::Point Point;
+
+    enum Operation
+    {
+        ADD,
+        SUBTRACT,
+        MULTIPLY,
+        MIN,
+        MAX
+    };
+
+    // Merges the knots of both operands and applies the operation on
+    // every merged segment
+    //
+    // @param _a            First operand
+    // @param _b            Second operand
+    // @param _operation    The operation
+    // @param _tolerance    Only used by MULTIPLY
+    // @return              The knots of the result
+    static std::vector<Point> combine(const FunctionToPiecewise &_a, const FunctionToPiecewise &_b,
+                                      Operation _operation, float _tolerance);
+
+    // Evaluates knots at x. _cursor is the index of the segment to start
+    // searching from and is moved forward, so evaluating ascending x values
+    // is linear overall.
+    //
+    // @param _knots    The knots
+    // @param _cursor   The segment index to start from
+    // @param _x        The x value, must be inside the knots' interval
+    // @return          The interpolated y value
+    static float interpolate(const std::vector<Point> &_knots, size_t &_cursor, float _x);
+
+    // @return  The operation applied to two values
+    static float apply(Operation _operation, float _a, float _b);
+};
+
+FunctionToPiecewise PiecewiseArithmetic::add(const FunctionToPiecewise &_a, const FunctionToPiecewise &_b)
+{
+    return FunctionToPiecewise(combine(_a, _b, ADD, 0));
+}
+
+FunctionToPiecewise PiecewiseArithmetic::subtract(const FunctionToPiecewise &_a, const FunctionToPiecewise &_b)
+{
+    return FunctionToPiecewise(combine(_a, _b, SUBTRACT, 0));
+}
+
+FunctionToPiecewise PiecewiseArithmetic::multiply(const FunctionToPiecewise &_a, const FunctionToPiecewise &_b, float _tolerance)
+{
+    if (!(_tolerance > 0))
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "The tolerance of a product must be positive");
+    }
+
+    return FunctionToPiecewise(combine(_a, _b, MULTIPLY, _tolerance));
+}
+
+FunctionToPiecewise PiecewiseArithmetic::min(const FunctionToPiecewise &_a, const FunctionToPiecewise &_b)
+{
+    return FunctionToPiecewise(combine(_a, _b, MIN, 0));
+}
+
+FunctionToPiecewise PiecewiseArithmetic::max(const FunctionToPiecewise &_a, const FunctionToPiecewise &_b)
+{
+    return FunctionToPiecewise(combine(_a, _b, MAX, 0));
+}
+
+FunctionToPiecewise PiecewiseArithmetic::affine(const FunctionToPiecewise &_a, float _gain, float _offset)
+{
+    std::vector<Point> knots = _a.getKnots();
+
+    for (size_t i = 0; i < knots.size(); i++)
+    {
+        knots[i].y = _gain * knots[i].y + _offset;
+    }
+
+    return FunctionToPiecewise(knots);
+}
+
+std::vector<FunctionToPiecewise::Point> PiecewiseArithmetic::combine(const FunctionToPiecewise &_a, const FunctionToPiecewise &_b,
+                                                                      Operation _operation, float _tolerance)
+{
+    const std::vector<Point> &aKnots = _a.getKnots();
+    const std::vector<Point> &bKnots = _b.getKnots();
+
+    // Only the interval where both are defined
+    float xStart = std::max(aKnots.front().x, bKnots.front().x);
+    float xEnd = std::min(aKnots.back().x, bKnots.back().x);
+
+    if (!(xEnd > xStart))
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "The piecewise functions' intervals do not overlap");
+    }
+
+    // Merge both knot lists, like the merge step of merge sort
+    std::vector<float> xs;
+    xs.reserve(aKnots.size() + bKnots.size());
+    xs.push_back(xStart);
+    size_t i = 0;
+    size_t j = 0;
+    while (i < aKnots.size() || j < bKnots.size())
+    {
+        float x;
+        if (j >= bKnots.size() || (i < aKnots.size() && aKnots[i].x < bKnots[j].x))
+            x = aKnots[i++].x;
+        else
+            x = bKnots[j++].x;
+
+        if (x > xs.back() && x < xEnd)
+            xs.push_back(x);
+    }
+    xs.push_back(xEnd);
+
+    std::vector<Point> knots;
+    knots.reserve(xs.size());
+    size_t aCursor = 0;
+    size_t bCursor = 0;
+
+    float a0 = interpolate(aKnots, aCursor, xs[0]);
+    float b0 = interpolate(bKnots, bCursor, xs[0]);
+    Point first;
+    first.x = xs[0];
+    first.y = apply(_operation, a0, b0);
+    knots.push_back(first);
+
+    for (size_t k = 1; k < xs.size(); k++)
+    {
+        float x0 = xs[k - 1];
+        float x1 = xs[k];
+        float a1 = interpolate(aKnots, aCursor, x1);
+        float b1 = interpolate(bKnots, bCursor, x1);
+
+        // Both operands are linear between x0 and x1
+        if ((_operation == MIN || _operation == MAX) && (a0 - b0) * (a1 - b1) < 0)
+        {
+            // Add a knot where the operands cross
+            float t = (a0 - b0) / ((a0 - b0) - (a1 - b1));
+            Point crossing;
+            crossing.x = x0 + t * (x1 - x0);
+            crossing.y = a0 + t * (a1 - a0);
+            knots.push_back(crossing);
+        }
+        else if (_operation == MULTIPLY)
+        {
+            // Over t in [0, 1] the product is quadratic with t^2 coefficient
+            // c. A chord over a piece of width w is off by at most c*w^2/4.
+            float c = (a1 - a0) * (b1 - b0);
+            int nPieces = (int)ceil(sqrt(fabs(c) / (4 * _tolerance)));
+
+            for (int p = 1; p < nPieces; p++)
+            {
+                float t = (float)p / nPieces;
+                Point inner;
+                inner.x = x0 + t * (x1 - x0);
+                inner.y = (a0 + t * (a1 - a0)) * (b0 + t * (b1 - b0));
+                knots.push_back(inner);
+            }
+        }
+
+        Point knot;
+        knot.x = x1;
+        knot.y = apply(_operation, a1, b1);
+        knots.push_back(knot);
+
+        a0 = a1;
+        b0 = b1;
+    }
+
+    return knots;
+}
+
+float PiecewiseArithmetic::interpolate(const std::vector<Point> &_knots, size_t &_cursor, float _x)
+{
+    while (_cursor + 2 < _knots.size() && _knots[_cursor + 1].x <= _x)
+        _cursor++;
+
+    Point pt1 = _knots[_cursor];
+    Point pt2 = _knots[_cursor + 1];
+    return pt1.y + (_x - pt1.x) * (pt2.y - pt1.y) / (pt2.x - pt1.x);
+}
+
+float PiecewiseArithmetic::apply(Operation _operation, float _a, float _b)
+{
+    switch (_operation)
+    {
+    case ADD:
+        return _a + _b;
+    case SUBTRACT:
+        return _a - _b;
+    case MULTIPLY:
+        return _a * _b;
+    case MIN:
+        return std::min(_a, _b);
+    case MAX:
+    default:
+        return std::max(_a, _b);
+    }
+}
+
+#endif //PIECEWISE_ARITHMETIC_H
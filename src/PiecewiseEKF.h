@@ -0,0 +1,173 @@
+// File: PiecewiseEKF.h
+// Author: David Antaki
+// Date: 10/18/2026
+// License: Closed source
+//
+// Contents: Extended Kalman filter that tracks the magnet position and
+// velocity of several channels from their raw sensor readings. The state
+// of a channel is [position, velocity] with a constant velocity model and
+// white acceleration noise. The measurement is the sensor function of the
+// position, taken from a piecewise table, and its Jacobian dB/dd is the
+// slope of the same segment, so an update needs no transcendental calls
+// and no numerical derivative. All channels are updated together: the
+// states and covariances are kept as arrays per component (structure of
+// arrays) so the filter equations run over all channels in one loop.
+
+#ifndef PIECEWISE_EKF_H
+#define PIECEWISE_EKF_H
+
+#include <vector>
+#include "mbed.h"
+#include "FunctionToPiecewise.h"
+
+class PiecewiseEKF
+{
+public:
+    // @param _measurement      The sensor function over position
+    // @param _nChannels        The number of channels
+    // @param _processNoise     Spectral density of the acceleration noise,
+    //                          in position^2 / s^3
+    // @param _measurementNoise Variance of a raw reading
+    PiecewiseEKF(const FunctionToPiecewise &_measurement, size_t _nChannels,
+                 float _processNoise, float _measurementNoise);
+
+    // Restarts one channel at a known state
+    //
+    // @param _channel          The channel
+    // @param _position         The position
+    // @param _positionVariance The variance of the position
+    // @param _velocityVariance The variance of the velocity
+    void reset(size_t _channel, float _position, float _positionVariance, float _velocityVariance);
+
+    // Predicts all channels _dt seconds ahead and corrects them with their
+    // new readings
+    //
+    // @param _measurements     One raw reading per channel
+    // @param _dt               Seconds since the last update
+    void update(const float *_measurements, float _dt);
+
+    // @return  The position estimates of all channels
+    const float *getPositions() const;
+
+    // @return  The velocity estimates of all channels
+    const float *getVelocities() const;
+
+    // @return  The variance of a channel's position estimate
+    float getPositionVariance(size_t _channel) const;
+
+private:
+    FunctionToPiecewise measurement;
+    size_t nChannels;
+    float processNoise;
+    float measurementNoise;
+
+    // The interval of the table, positions are clamped to it
+    float first, last;
+
+    // State and symmetric covariance [p00 p01; p01 p11] of every channel
+    std::vector<float> positions;
+    std::vector<float> velocities;
+    std::vector<float> p00, p01, p11;
+
+    // Predicted readings and Jacobians, reused between updates
+    std::vector<float> predicted;
+    std::vector<float> slopes;
+};
+
+PiecewiseEKF::PiecewiseEKF(const FunctionToPiecewise &_measurement, size_t _nChannels,
+                           float _processNoise, float _measurementNoise)
+    : measurement(_measurement)
+{
+    if (_nChannels < 1 || _processNoise < 0 || !(_measurementNoise > 0))
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "Invalid number of channels or noise of the filter");
+    }
+
+    nChannels = _nChannels;
+    processNoise = _processNoise;
+    measurementNoise = _measurementNoise;
+    first = measurement.getKnots().front().x;
+    last = measurement.getKnots().back().x;
+
+    // Start in the middle of the table, knowing nothing
+    positions.assign(nChannels, (first + last) / 2);
+    velocities.assign(nChannels, 0);
+    p00.assign(nChannels, (last - first) * (last - first));
+    p01.assign(nChannels, 0);
+    p11.assign(nChannels, (last - first) * (last - first));
+    predicted.resize(nChannels);
+    slopes.resize(nChannels);
+}
+
+void PiecewiseEKF::reset(size_t _channel, float _position, float _positionVariance, float _velocityVariance)
+{
+    if (_channel >= nChannels)
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "Filter channel is out of range");
+    }
+
+    positions[_channel] = _position;
+    velocities[_channel] = 0;
+    p00[_channel] = _positionVariance;
+    p01[_channel] = 0;
+    p11[_channel] = _velocityVariance;
+}
+
+void PiecewiseEKF::update(const float *_measurements, float _dt)
+{
+    // Process noise of a constant velocity model over _dt
+    float q00 = processNoise * _dt * _dt * _dt / 3;
+    float q01 = processNoise * _dt * _dt / 2;
+    float q11 = processNoise * _dt;
+
+    // Predict
+    for (size_t i = 0; i < nChannels; i++)
+    {
+        float position = positions[i] + velocities[i] * _dt;
+        positions[i] = (position < first) ? first : ((position > last) ? last : position);
+
+        p00[i] += _dt * (2 * p01[i] + _dt * p11[i]) + q00;
+        p01[i] += _dt * p11[i] + q01;
+        p11[i] += q11;
+    }
+
+    // The measurement and its Jacobian H = [slope 0] at every prediction
+    measurement.xToyBatchWithSlope(positions.data(), predicted.data(), slopes.data(), nChannels);
+
+    // Correct
+    for (size_t i = 0; i < nChannels; i++)
+    {
+        float innovation = _measurements[i] - predicted[i];
+        float s = slopes[i];
+        float innovationVariance = s * s * p00[i] + measurementNoise;
+        float k0 = p00[i] * s / innovationVariance;
+        float k1 = p01[i] * s / innovationVariance;
+
+        float position = positions[i] + k0 * innovation;
+        positions[i] = (position < first) ? first : ((position > last) ? last : position);
+        velocities[i] += k1 * innovation;
+
+        // P = (I - K H) P
+        float p01Before = p01[i];
+        p00[i] -= k0 * s * p00[i];
+        p01[i] -= k0 * s * p01Before;
+        p11[i] -= k1 * s * p01Before;
+    }
+}
+
+const float *PiecewiseEKF::getPositions() const
+{
+    return positions.data();
+}
+
+const float *PiecewiseEKF::getVelocities() const
+{
+    return velocities.data();
+}
+
+float PiecewiseEKF::getPositionVariance(size_t _channel) const
+{
+    return p00[_channel];
+}
+
+#endif //PIECEWISE_EKF_H
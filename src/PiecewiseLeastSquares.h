@@ -0,0 +1,417 @@
+// File: PiecewiseLeastSquares.h
+// Author: David Antaki
+// Date: 10/18/2026
+// License: Closed source
+//
+// Contents: Fits a continuous piecewise linear function to noisy (x, y)
+// samples in the least-squares sense, instead of interpolating the samples
+// exactly. The knots are evenly spaced over the interval and the knot
+// y-values are the unknowns. Every sample only touches the two knots of the
+// segment it falls in, so the normal equations are tridiagonal and are
+// solved in O(n) with the Thomas algorithm. A monotonic fit is solved
+// exactly with an active-set method whose working set pools neighbouring
+// knots, which keeps every solve tridiagonal. The result is returned as a
+// FunctionToPiecewise so it can be used exactly like a sampled table.
+
+#ifndef PIECEWISE_LEAST_SQUARES_H
+#define PIECEWISE_LEAST_SQUARES_H
+
+#include <vector>
+#include "mbed.h"
+#include "FunctionToPiecewise.h"
+
+class PiecewiseLeastSquares
+{
+public:
+    // Optional constraint on the fitted knot values
+    enum Monotonicity
+    {
+        NONE,
+        INCREASING,
+        DECREASING
+    };
+
+    // @param _nSegments    The number of linear segments of the fitted
+    //                      piecewise function.
+    // @param _interval     The interval along the x-axis that is fitted.
+    //                      Samples outside of it are ignored.
+    // @param _monotonic    Forces the fitted knot values to be increasing
+    //                      or decreasing, e.g. so yTox() is well defined.
+    //                      Where the samples are not monotonic neighbouring
+    //                      knots come out equal, and yTox() of such a flat
+    //                      run returns one of its knots.
+    // @param _smoothing    Weight of the penalty on the difference between
+    //                      neighbouring knots, relative to the average
+    //                      number of samples per knot. Keeps knots that
+    //                      have no samples around them well defined.
+    PiecewiseLeastSquares(int _nSegments, std::pair<float, float> _interval,
+                          Monotonicity _monotonic = NONE, float _smoothing = 1e-4);
+
+    // Adds one sample to the fit. O(1).
+    //
+    // @param _x    The x value of the sample
+    // @param _y    The measured y value of the sample
+    void addSample(float _x, float _y);
+
+    // Adds _n samples to the fit.
+    //
+    // @param _x    Array of _n x values
+    // @param _y    Array of _n measured y values
+    // @param _n    The number of samples
+    void addSamples(const float *_x, const float *_y, size_t _n);
+
+    // Adds a group of samples that all fall in one segment from their
+    // moments, e.g. aggregated by StreamingPiecewiseFit. t is the position
+    // of a sample inside the segment, from 0 at its left knot to 1 at its
+    // right knot. O(1).
+    //
+    // @param _segment  The segment of the samples
+    // @param _n        The number of samples
+    // @param _sumT     Sum of t
+    // @param _sumTT    Sum of t^2
+    // @param _sumY     Sum of y
+    // @param _sumTY    Sum of t*y
+    void addMoments(int _segment, double _n, double _sumT, double _sumTT, double _sumY, double _sumTY);
+
+    // Solves for the knots that best fit the samples added so far.
+    //
+    // @return      The fitted knots sorted by ascending x.
+    std::vector<FunctionToPiecewise::Point> fitKnots();
+
+    // Solves for the best fitting piecewise function.
+    //
+    // @return      The fitted piecewise function.
+    FunctionToPiecewise fit();
+
+private:
+    int nSegments;
+    std::pair<float, float> interval;
+    float xIncrement;
+    Monotonicity monotonic;
+    float smoothing;
+
+    // Number of samples added so far
+    size_t nSamples;
+
+    // The tridiagonal normal equations. diag[k] is the k'th diagonal
+    // entry, offDiag[k] couples knot k and knot k+1 and rhs[k] is the
+    // k'th entry of the right hand side.
+    std::vector<double> diag;
+    std::vector<double> offDiag;
+    std::vector<double> rhs;
+
+    // Solves the tridiagonal system with the Thomas algorithm
+    //
+    // @param _diag     Diagonal, n entries
+    // @param _offDiag  Symmetric off-diagonal, n-1 entries
+    // @param _rhs      Right hand side, n entries
+    // @return          The solution
+    std::vector<double> solveTridiagonal(std::vector<double> _diag,
+                                         const std::vector<double> &_offDiag,
+                                         std::vector<double> _rhs);
+
+    // Solves the tridiagonal system with runs of knots forced to be equal.
+    // Every run becomes one unknown, which keeps the system tridiagonal.
+    //
+    // @param _diag     Diagonal, n entries
+    // @param _offDiag  Symmetric off-diagonal, n-1 entries
+    // @param _rhs      Right hand side, n entries
+    // @param _pooled   _pooled[k] forces knot k and knot k+1 to be equal,
+    //                  n-1 entries
+    // @return          The solution, n entries
+    std::vector<double> solvePooled(const std::vector<double> &_diag,
+                                    const std::vector<double> &_offDiag,
+                                    const std::vector<double> &_rhs,
+                                    const std::vector<char> &_pooled);
+
+    // Minimizes the least-squares objective of the tridiagonal system
+    // subject to increasing knot values, with a primal active-set method.
+    // The working set holds the neighbouring knots that are forced to be
+    // equal. It starts with all knots pooled, which is feasible, adds the
+    // constraint that blocks each step and releases the one with the most
+    // negative Lagrange multiplier once the step is complete.
+    //
+    // @param _diag     Diagonal, n entries
+    // @param _offDiag  Symmetric off-diagonal, n-1 entries
+    // @param _rhs      Right hand side, n entries
+    // @return          The increasing solution, n entries
+    std::vector<double> solveIncreasing(const std::vector<double> &_diag,
+                                        const std::vector<double> &_offDiag,
+                                        const std::vector<double> &_rhs);
+};
+
+PiecewiseLeastSquares::PiecewiseLeastSquares(int _nSegments, std::pair<float, float> _interval,
+                                             Monotonicity _monotonic, float _smoothing)
+{
+    if (_nSegments < 1 || !(_interval.second > _interval.first))
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "Invalid number of segments or interval for the least-squares fit");
+    }
+
+    nSegments = _nSegments;
+    interval = _interval;
+    xIncrement = (_interval.second - _interval.first) / _nSegments;
+    monotonic = _monotonic;
+    smoothing = _smoothing;
+    nSamples = 0;
+
+    diag.assign(nSegments + 1, 0.0);
+    offDiag.assign(nSegments, 0.0);
+    rhs.assign(nSegments + 1, 0.0);
+}
+
+void PiecewiseLeastSquares::addSample(float _x, float _y)
+{
+    if (_x < interval.first || _x > interval.second)
+        return;
+
+    // Position of the sample in units of segments
+    float pos = (_x - interval.first) / xIncrement;
+    int k = (int)pos;
+    if (k >= nSegments)
+        k = nSegments - 1;
+
+    // Hat basis weights of the left (w0) and right (w1) knot of segment k
+    double w1 = pos - k;
+    double w0 = 1.0 - w1;
+
+    diag[k] += w0 * w0;
+    diag[k + 1] += w1 * w1;
+    offDiag[k] += w0 * w1;
+    rhs[k] += w0 * _y;
+    rhs[k + 1] += w1 * _y;
+
+    nSamples++;
+}
+
+void PiecewiseLeastSquares::addSamples(const float *_x, const float *_y, size_t _n)
+{
+    for (size_t i = 0; i < _n; i++)
+    {
+        addSample(_x[i], _y[i]);
+    }
+}
+
+void PiecewiseLeastSquares::addMoments(int _segment, double _n, double _sumT, double _sumTT, double _sumY, double _sumTY)
+{
+    if (_segment < 0 || _segment >= nSegments)
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "Segment of the moments is out of range");
+    }
+
+    // The sums of addSample() over the group, with w0 = 1 - t and w1 = t
+    diag[_segment] += _n - 2 * _sumT + _sumTT;
+    diag[_segment + 1] += _sumTT;
+    offDiag[_segment] += _sumT - _sumTT;
+    rhs[_segment] += _sumY - _sumTY;
+    rhs[_segment + 1] += _sumTY;
+
+    nSamples += (size_t)_n;
+}
+
+std::vector<FunctionToPiecewise::Point> PiecewiseLeastSquares::fitKnots()
+{
+    if (nSamples < 2)
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "Not enough samples for the least-squares fit");
+    }
+
+    // Add the smoothing penalty lambda * (a[k+1] - a[k])^2, which keeps the
+    // system tridiagonal.
+    double lambda = smoothing * ((double)nSamples / (nSegments + 1));
+    if (lambda <= 0)
+        lambda = 1e-9;
+
+    std::vector<double> penalizedDiag = diag;
+    std::vector<double> penalizedOffDiag = offDiag;
+    for (int k = 0; k < nSegments; k++)
+    {
+        penalizedDiag[k] += lambda;
+        penalizedDiag[k + 1] += lambda;
+        penalizedOffDiag[k] -= lambda;
+    }
+
+    std::vector<double> values;
+    if (monotonic == INCREASING)
+    {
+        values = solveIncreasing(penalizedDiag, penalizedOffDiag, rhs);
+    }
+    else if (monotonic == DECREASING)
+    {
+        // Decreasing values a are increasing values -a of the system with
+        // the right hand side negated
+        std::vector<double> negatedRhs(rhs.size());
+        for (size_t i = 0; i < rhs.size(); i++)
+            negatedRhs[i] = -rhs[i];
+        values = solveIncreasing(penalizedDiag, penalizedOffDiag, negatedRhs);
+        for (size_t i = 0; i < values.size(); i++)
+            values[i] = -values[i];
+    }
+    else
+    {
+        values = solveTridiagonal(penalizedDiag, penalizedOffDiag, rhs);
+    }
+
+    std::vector<FunctionToPiecewise::Point> knots(nSegments + 1);
+    for (int k = 0; k <= nSegments; k++)
+    {
+        knots[k].x = interval.first + k * xIncrement;
+        knots[k].y = (float)values[k];
+    }
+    // Avoid rounding the last knot short of the interval
+    knots[nSegments].x = interval.second;
+
+    return knots;
+}
+
+FunctionToPiecewise PiecewiseLeastSquares::fit()
+{
+    return FunctionToPiecewise(fitKnots());
+}
+
+std::vector<double> PiecewiseLeastSquares::solveTridiagonal(std::vector<double> _diag,
+                                                            const std::vector<double> &_offDiag,
+                                                            std::vector<double> _rhs)
+{
+    size_t n = _diag.size();
+
+    // Forward elimination
+    for (size_t i = 1; i < n; i++)
+    {
+        double m = _offDiag[i - 1] / _diag[i - 1];
+        _diag[i] -= m * _offDiag[i - 1];
+        _rhs[i] -= m * _rhs[i - 1];
+    }
+
+    // Back substitution
+    std::vector<double> x(n);
+    x[n - 1] = _rhs[n - 1] / _diag[n - 1];
+    for (size_t i = n - 1; i-- > 0;)
+    {
+        x[i] = (_rhs[i] - _offDiag[i] * x[i + 1]) / _diag[i];
+    }
+
+    return x;
+}
+
+std::vector<double> PiecewiseLeastSquares::solvePooled(const std::vector<double> &_diag,
+                                                       const std::vector<double> &_offDiag,
+                                                       const std::vector<double> &_rhs,
+                                                       const std::vector<char> &_pooled)
+{
+    size_t n = _diag.size();
+
+    // Sum the rows and columns of every run of pooled knots
+    std::vector<double> runDiag;
+    std::vector<double> runOffDiag;
+    std::vector<double> runRhs;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (i == 0 || !_pooled[i - 1])
+        {
+            if (i > 0)
+                runOffDiag.push_back(_offDiag[i - 1]);
+            runDiag.push_back(0.0);
+            runRhs.push_back(0.0);
+        }
+        else
+        {
+            runDiag.back() += 2 * _offDiag[i - 1];
+        }
+        runDiag.back() += _diag[i];
+        runRhs.back() += _rhs[i];
+    }
+
+    std::vector<double> runValues = solveTridiagonal(runDiag, runOffDiag, runRhs);
+
+    std::vector<double> values(n);
+    size_t run = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (i > 0 && !_pooled[i - 1])
+            run++;
+        values[i] = runValues[run];
+    }
+
+    return values;
+}
+
+std::vector<double> PiecewiseLeastSquares::solveIncreasing(const std::vector<double> &_diag,
+                                                           const std::vector<double> &_offDiag,
+                                                           const std::vector<double> &_rhs)
+{
+    size_t n = _diag.size();
+
+    // Multipliers within this of 0 count as 0, so rounding does not
+    // release and re-add the same constraint forever
+    double tolerance = 0;
+    for (size_t i = 0; i < n; i++)
+        tolerance += fabs(_rhs[i]);
+    tolerance = 1e-9 * (tolerance + 1);
+
+    std::vector<char> pooled(n - 1, 1);
+    std::vector<double> values = solvePooled(_diag, _offDiag, _rhs, pooled);
+
+    // Every iteration adds or releases one constraint. The values stay
+    // feasible throughout, so the cap only limits how close to the
+    // optimum a degenerate problem gets.
+    for (size_t iteration = 0; iteration < 4 * n + 16; iteration++)
+    {
+        std::vector<double> target = solvePooled(_diag, _offDiag, _rhs, pooled);
+
+        // Step towards the target until a free constraint is hit
+        double alpha = 1;
+        size_t blocking = n;
+        for (size_t k = 0; k + 1 < n; k++)
+        {
+            double step = target[k + 1] - target[k];
+            if (pooled[k] || step >= 0)
+                continue;
+
+            double gap = std::max(values[k + 1] - values[k], 0.0);
+            double t = gap / (gap - step);
+            if (t < alpha)
+            {
+                alpha = t;
+                blocking = k;
+            }
+        }
+
+        if (blocking < n)
+        {
+            for (size_t i = 0; i < n; i++)
+                values[i] += alpha * (target[i] - values[i]);
+            pooled[blocking] = 1;
+            continue;
+        }
+        values = target;
+
+        // The values are optimal for the working set. The multiplier of
+        // the constraint between knot k and k+1 is minus the sum of the
+        // gradient over knots 0..k.
+        double multiplier = 0;
+        double mostNegative = -tolerance;
+        size_t release = n;
+        for (size_t k = 0; k + 1 < n; k++)
+        {
+            double gradient = _diag[k] * values[k] + _offDiag[k] * values[k + 1] - _rhs[k];
+            if (k > 0)
+                gradient += _offDiag[k - 1] * values[k - 1];
+
+            multiplier -= gradient;
+            if (pooled[k] && multiplier < mostNegative)
+            {
+                mostNegative = multiplier;
+                release = k;
+            }
+        }
+
+        if (release == n)
+            break;
+        pooled[release] = 0;
+    }
+
+    return values;
+}
+
+#endif //PIECEWISE_LEAST_SQUARES_H
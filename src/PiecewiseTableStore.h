@@ -0,0 +1,356 @@
+// File: PiecewiseTableStore.h
+// Author: David Antaki
+// Date: 10/18/2026
+// License: Closed source
+//
+// Contents: Builds and holds many piecewise functions that share one knot
+// grid, e.g. one calibration table per unit on the production line. Since
+// every table has the same knot x-values, only the knot y-values are
+// stored, packed back to back in one contiguous array, and a table is
+// addressed by its handle. Tables are built from parameter sets of a
+// function or fitted to sample sets, on several threads where the
+// platform has them.
+
+#ifndef PIECEWISE_TABLE_STORE_H
+#define PIECEWISE_TABLE_STORE_H
+
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include "mbed.h"
+#include "FunctionToPiecewise.h"
+#include "PiecewiseLeastSquares.h"
+
+// Hosts build the tables on several threads, MCUs build them one by one
+#if defined(__unix__) || defined(__APPLE__)
+#define PIECEWISE_TABLE_STORE_THREADS
+#include <thread>
+#endif
+
+class PiecewiseTableStore
+{
+public:
+    // Addresses one table in the store
+    typedef size_t Handle;
+
+    // Samples of one unit to fit a table to
+    typedef struct
+    {
+        const float *x;
+        const float *y;
+        size_t n;
+    } SampleSet;
+
+    // @param _nSegments    The number of segments of every table
+    // @param _interval     The interval of every table
+    PiecewiseTableStore(int _nSegments, std::pair<float, float> _interval);
+
+    // Builds one table per parameter set by sampling _function on the
+    // shared grid.
+    //
+    // @param _function     The function, called as _function(x, params)
+    //                      where params points to one parameter set
+    // @param _params       _nSets parameter sets of _nParams floats each,
+    //                      back to back
+    // @param _nParams      The number of parameters in one set
+    // @param _nSets        The number of parameter sets
+    // @param _nThreads     The number of threads to build on
+    // @return              The handle of the first new table, the others
+    //                      follow consecutively
+    Handle buildFromParameters(float (*_function)(float, const float *), const float *_params,
+                               size_t _nParams, size_t _nSets, int _nThreads = 4);
+
+    // Fits one table per sample set with PiecewiseLeastSquares. Every set
+    // needs at least 2 samples inside the interval; all sets are checked
+    // before any thread starts.
+    //
+    // @param _sampleSets   The sample sets
+    // @param _monotonic    The monotonicity constraint of the fits
+    // @param _nThreads     The number of threads to build on
+    // @return              The handle of the first new table, the others
+    //                      follow consecutively
+    Handle buildFromSamples(const std::vector<SampleSet> &_sampleSets,
+                            PiecewiseLeastSquares::Monotonicity _monotonic = PiecewiseLeastSquares::NONE,
+                            int _nThreads = 4);
+
+    // @return  The number of tables in the store
+    size_t size() const;
+
+    // Same as FunctionToPiecewise::xToy() on one table
+    //
+    // @param _handle   The table
+    // @param _x        The x value
+    // @return          The y value
+    float xToy(Handle _handle, float _x) const;
+
+    // Same as FunctionToPiecewise::yTox() on one table
+    //
+    // @param _handle   The table
+    // @param _y        The y value
+    // @return          The x value
+    float yTox(Handle _handle, float _y) const;
+
+    // Copies one table out of the store into a FunctionToPiecewise
+    //
+    // @param _handle   The table
+    // @return          The table as a FunctionToPiecewise
+    FunctionToPiecewise toPiecewise(Handle _handle) const;
+
+private:
+    int nSegments;
+    std::pair<float, float> interval;
+    float xIncrement;
+
+    // The knot y-values of all tables, nSegments + 1 per table
+    std::vector<float> ys;
+
+    // 1 if a table rises, -1 if it falls and 0 if it is not monotonic
+    std::vector<int8_t> directions;
+
+    // Makes room for _nSets more tables
+    //
+    // @return  The handle of the first new table
+    Handle allocate(size_t _nSets);
+
+    // Runs _build(i) for every i in [0, _n) on _nThreads threads
+    template <class Build>
+    void parallelFor(size_t _n, int _nThreads, Build _build);
+
+    // Sets the direction of a table from its knots
+    void updateDirection(Handle _handle);
+
+    // @return  The x-value of knot _k
+    float knotX(size_t _k) const;
+};
+
+PiecewiseTableStore::PiecewiseTableStore(int _nSegments, std::pair<float, float> _interval)
+{
+    if (_nSegments < 1 || !(_interval.second > _interval.first))
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "Invalid number of segments or interval for the table store");
+    }
+
+    nSegments = _nSegments;
+    interval = _interval;
+    xIncrement = (_interval.second - _interval.first) / _nSegments;
+}
+
+PiecewiseTableStore::Handle PiecewiseTableStore::buildFromParameters(float (*_function)(float, const float *), const float *_params,
+                                                                     size_t _nParams, size_t _nSets, int _nThreads)
+{
+    Handle first = allocate(_nSets);
+
+    parallelFor(_nSets, _nThreads, [this, _function, _params, _nParams, first](size_t _i) {
+        const float *params = _params + _i * _nParams;
+        float *tableYs = &ys[(first + _i) * (nSegments + 1)];
+
+        for (int k = 0; k <= nSegments; k++)
+        {
+            tableYs[k] = (*_function)(knotX(k), params);
+        }
+        updateDirection(first + _i);
+    });
+
+    return first;
+}
+
+PiecewiseTableStore::Handle PiecewiseTableStore::buildFromSamples(const std::vector<SampleSet> &_sampleSets,
+                                                                  PiecewiseLeastSquares::Monotonicity _monotonic,
+                                                                  int _nThreads)
+{
+    // A fit that fails inside a worker thread could not be reported
+    for (size_t i = 0; i < _sampleSets.size(); i++)
+    {
+        size_t nInside = 0;
+        for (size_t j = 0; j < _sampleSets[i].n; j++)
+        {
+            if (_sampleSets[i].x[j] >= interval.first && _sampleSets[i].x[j] <= interval.second)
+                nInside++;
+        }
+
+        if (nInside < 2)
+        {
+            MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "Every sample set needs at least 2 samples inside the interval");
+        }
+    }
+
+    Handle first = allocate(_sampleSets.size());
+
+    parallelFor(_sampleSets.size(), _nThreads, [&](size_t _i) {
+        PiecewiseLeastSquares fitter(nSegments, interval, _monotonic);
+        fitter.addSamples(_sampleSets[_i].x, _sampleSets[_i].y, _sampleSets[_i].n);
+        std::vector<FunctionToPiecewise::Point> knots = fitter.fitKnots();
+
+        float *tableYs = &ys[(first + _i) * (nSegments + 1)];
+        for (int k = 0; k <= nSegments; k++)
+        {
+            tableYs[k] = knots[k].y;
+        }
+        updateDirection(first + _i);
+    });
+
+    return first;
+}
+
+size_t PiecewiseTableStore::size() const
+{
+    return directions.size();
+}
+
+float PiecewiseTableStore::xToy(Handle _handle, float _x) const
+{
+    if (_handle >= size() || _x < interval.first || _x > interval.second)
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "_x value is out of the piecewise function's interval");
+    }
+
+    const float *tableYs = &ys[_handle * (nSegments + 1)];
+    float pos = (_x - interval.first) / xIncrement;
+    int k = std::min((int)pos, nSegments - 1);
+    float t = pos - k;
+
+    return tableYs[k] + t * (tableYs[k + 1] - tableYs[k]);
+}
+
+float PiecewiseTableStore::yTox(Handle _handle, float _y) const
+{
+    if (_handle >= size())
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "Invalid table handle");
+    }
+
+    const float *tableYs = &ys[_handle * (nSegments + 1)];
+    int8_t direction = directions[_handle];
+    int k = -1;
+
+    if (direction != 0)
+    {
+        // Binary search for the segment, in terms of direction * y so the
+        // knots are ascending
+        float key = direction * _y;
+        if (key >= direction * tableYs[0] && key <= direction * tableYs[nSegments])
+        {
+            int low = 0;
+            int high = nSegments;
+            while (high - low > 1)
+            {
+                int mid = (low + high) / 2;
+                if (direction * tableYs[mid] <= key)
+                    low = mid;
+                else
+                    high = mid;
+            }
+            k = low;
+        }
+    }
+    else
+    {
+        for (int i = 0; i < nSegments; i++)
+        {
+            float yMin = std::min(tableYs[i], tableYs[i + 1]);
+            float yMax = std::max(tableYs[i], tableYs[i + 1]);
+            if (_y >= yMin && _y <= yMax)
+            {
+                k = i;
+                break;
+            }
+        }
+    }
+
+    if (k < 0)
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "_y value is out of the piecewise function's range");
+    }
+
+    if (tableYs[k + 1] == tableYs[k])
+        return knotX(k);
+
+    float t = (_y - tableYs[k]) / (tableYs[k + 1] - tableYs[k]);
+    return knotX(k) + t * xIncrement;
+}
+
+FunctionToPiecewise PiecewiseTableStore::toPiecewise(Handle _handle) const
+{
+    if (_handle >= size())
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "Invalid table handle");
+    }
+
+    std::vector<FunctionToPiecewise::Point> knots(nSegments + 1);
+    for (int k = 0; k <= nSegments; k++)
+    {
+        knots[k].x = knotX(k);
+        knots[k].y = ys[_handle * (nSegments + 1) + k];
+    }
+
+    return FunctionToPiecewise(knots);
+}
+
+PiecewiseTableStore::Handle PiecewiseTableStore::allocate(size_t _nSets)
+{
+    Handle first = size();
+
+    // Allocate everything up front so the threads never reallocate
+    ys.resize((first + _nSets) * (nSegments + 1));
+    directions.resize(first + _nSets);
+
+    return first;
+}
+
+template <class Build>
+void PiecewiseTableStore::parallelFor(size_t _n, int _nThreads, Build _build)
+{
+#ifdef PIECEWISE_TABLE_STORE_THREADS
+    size_t nThreads = std::max(1, std::min(_nThreads, (int)_n));
+    std::vector<std::thread> threads;
+
+    // Every thread builds a contiguous block of tables
+    for (size_t t = 0; t < nThreads; t++)
+    {
+        size_t begin = _n * t / nThreads;
+        size_t end = _n * (t + 1) / nThreads;
+        threads.push_back(std::thread([=]() {
+            for (size_t i = begin; i < end; i++)
+                _build(i);
+        }));
+    }
+
+    for (size_t t = 0; t < threads.size(); t++)
+    {
+        threads[t].join();
+    }
+#else
+    for (size_t i = 0; i < _n; i++)
+    {
+        _build(i);
+    }
+#endif
+}
+
+void PiecewiseTableStore::updateDirection(Handle _handle)
+{
+    const float *tableYs = &ys[_handle * (nSegments + 1)];
+    bool rising = false;
+    bool falling = false;
+
+    for (int k = 0; k < nSegments; k++)
+    {
+        rising |= tableYs[k + 1] > tableYs[k];
+        falling |= tableYs[k + 1] < tableYs[k];
+    }
+
+    if (rising && falling)
+        directions[_handle] = 0;
+    else
+        directions[_handle] = falling ? -1 : 1;
+}
+
+float PiecewiseTableStore::knotX(size_t _k) const
+{
+    // Avoid rounding the last knot short of the interval
+    if ((int)_k == nSegments)
+        return interval.second;
+    return interval.first + _k * xIncrement;
+}
+
+#endif //PIECEWISE_TABLE_STORE_H
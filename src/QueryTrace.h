@@ -0,0 +1,210 @@
+// File: QueryTrace.h
+// Author: David Antaki
+// Date: 10/18/2026
+// License: Closed source
+//
+// Contents: Records the inputs of xToy() and yTox() calls into a compact
+// binary trace, so real access patterns can be replayed offline (see
+// TraceReplay.h). Attach a trace with FunctionToPiecewise::setTrace().
+// Recording is an append to a buffer that is allocated up front; once the
+// buffer is full further queries are only counted, so recording never
+// allocates in the lookup path.
+//
+// File format: the 4 magic bytes "FTPT", a uint32 version, a uint32 record
+// count and then 5 bytes per record: the operation (0 = xToy, 1 = yTox)
+// followed by the input as an IEEE 754 float. All numbers are little-endian
+// whatever the byte order of the target, so a trace recorded on the
+// device replays on any host.
+
+#ifndef QUERY_TRACE_H
+#define QUERY_TRACE_H
+
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include "mbed.h"
+
+class QueryTrace
+{
+public:
+    // The function a query went to
+    enum Operation
+    {
+        X_TO_Y = 0,
+        Y_TO_X = 1
+    };
+
+    // One recorded query
+    typedef struct
+    {
+        Operation operation;
+        float input;
+    } Query;
+
+    // @param _capacity     The most queries that are recorded
+    QueryTrace(size_t _capacity);
+
+    // Appends one query if there is room left
+    //
+    // @param _operation    The function the query went to
+    // @param _input        The input of the query
+    void record(Operation _operation, float _input)
+    {
+        if (size + RECORD_SIZE > buffer.size())
+        {
+            nDropped++;
+            return;
+        }
+
+        uint32_t bits;
+        memcpy(&bits, &_input, sizeof(float));
+
+        uint8_t *record = &buffer[size];
+        record[0] = _operation;
+        writeLittleEndian(record + 1, bits);
+        size += RECORD_SIZE;
+    }
+
+    // @return  The number of recorded queries
+    size_t count() const;
+
+    // @return  The number of queries that did not fit in the buffer
+    size_t dropped() const;
+
+    // @param _index    The index of the query
+    // @return          The recorded query
+    Query get(size_t _index) const;
+
+    // Forgets all recorded queries
+    void clear();
+
+    // Writes the trace to a file
+    //
+    // @param _file     A file opened for binary writing
+    // @return          True on success
+    bool save(FILE *_file) const;
+
+    // Replaces the trace with one read from a file. The capacity grows to
+    // fit the file. Fails on a record with an unknown operation.
+    //
+    // @param _file     A file opened for binary reading
+    // @return          True on success
+    bool load(FILE *_file);
+
+private:
+    // 1 byte operation and 4 bytes float
+    static const size_t RECORD_SIZE = 5;
+    static const uint32_t VERSION = 1;
+
+    std::vector<uint8_t> buffer;
+    size_t size;
+    size_t nDropped;
+
+    // Stores _value as 4 little-endian bytes
+    static void writeLittleEndian(uint8_t *_bytes, uint32_t _value)
+    {
+        _bytes[0] = (uint8_t)_value;
+        _bytes[1] = (uint8_t)(_value >> 8);
+        _bytes[2] = (uint8_t)(_value >> 16);
+        _bytes[3] = (uint8_t)(_value >> 24);
+    }
+
+    // @return  The value of 4 little-endian bytes
+    static uint32_t readLittleEndian(const uint8_t *_bytes)
+    {
+        return (uint32_t)_bytes[0] | ((uint32_t)_bytes[1] << 8) |
+               ((uint32_t)_bytes[2] << 16) | ((uint32_t)_bytes[3] << 24);
+    }
+};
+
+const size_t QueryTrace::RECORD_SIZE;
+const uint32_t QueryTrace::VERSION;
+
+QueryTrace::QueryTrace(size_t _capacity)
+{
+    buffer.assign(_capacity * RECORD_SIZE, 0);
+    size = 0;
+    nDropped = 0;
+}
+
+size_t QueryTrace::count() const
+{
+    return size / RECORD_SIZE;
+}
+
+size_t QueryTrace::dropped() const
+{
+    return nDropped;
+}
+
+QueryTrace::Query QueryTrace::get(size_t _index) const
+{
+    if (_index >= count())
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "Query index is out of the trace");
+    }
+
+    const uint8_t *record = &buffer[_index * RECORD_SIZE];
+    Query query;
+    uint32_t bits = readLittleEndian(record + 1);
+    query.operation = (Operation)record[0];
+    memcpy(&query.input, &bits, sizeof(float));
+    return query;
+}
+
+void QueryTrace::clear()
+{
+    size = 0;
+    nDropped = 0;
+}
+
+bool QueryTrace::save(FILE *_file) const
+{
+    uint8_t header[8];
+    writeLittleEndian(header, VERSION);
+    writeLittleEndian(header + 4, (uint32_t)count());
+
+    // The records are stored little-endian already
+    return fwrite("FTPT", 1, 4, _file) == 4 &&
+           fwrite(header, 1, sizeof(header), _file) == sizeof(header) &&
+           fwrite(buffer.data(), 1, size, _file) == size;
+}
+
+bool QueryTrace::load(FILE *_file)
+{
+    char magic[4];
+    uint8_t header[8];
+
+    if (fread(magic, 1, 4, _file) != 4 || memcmp(magic, "FTPT", 4) != 0 ||
+        fread(header, 1, sizeof(header), _file) != sizeof(header) ||
+        readLittleEndian(header) != VERSION)
+    {
+        return false;
+    }
+
+    size_t bytes = (size_t)readLittleEndian(header + 4) * RECORD_SIZE;
+    if (buffer.size() < bytes)
+        buffer.resize(bytes);
+
+    nDropped = 0;
+    size = fread(buffer.data(), 1, bytes, _file);
+    if (size != bytes)
+    {
+        size = 0;
+        return false;
+    }
+
+    for (size_t i = 0; i < size; i += RECORD_SIZE)
+    {
+        if (buffer[i] != X_TO_Y && buffer[i] != Y_TO_X)
+        {
+            size = 0;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+#endif //QUERY_TRACE_H
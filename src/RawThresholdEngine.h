@@ -0,0 +1,207 @@
+// File: RawThresholdEngine.h
+// Author: David Antaki
+// Date: 10/18/2026
+// License: Closed source
+//
+// Contents: Detects actuation and release events of many hall sensor
+// channels directly on the raw readings. Every channel's actuation and
+// release distances are converted to raw thresholds once with the
+// piecewise function, so no raw sample is ever converted to a distance.
+// The thresholds are recalculated whenever the piecewise function is
+// swapped. The piecewise function must be monotonic, otherwise a raw
+// reading does not tell which side of a threshold the magnet is on. A table that is changed in place, e.g. by OnlineCalibration or
+// setKnotY(), is not noticed: call setPiecewise() with it again.
+//
+// The comparisons of all channels are done in a branchless loop over
+// plain arrays, which the compiler vectorizes on targets with SIMD; only
+// the channels that changed state are visited afterwards.
+
+#ifndef RAW_THRESHOLD_ENGINE_H
+#define RAW_THRESHOLD_ENGINE_H
+
+#include <vector>
+#include <stdint.h>
+#include "mbed.h"
+#include "FunctionToPiecewise.h"
+
+class RawThresholdEngine
+{
+public:
+    // An actuation or release of one channel
+    typedef struct
+    {
+        int channel;
+        bool actuated;
+    } Event;
+
+    // @param _piecewise    The piecewise function that maps distance (x) to
+    //                      flux density (y). It must outlive this object.
+    // @param _rawGain      Converts flux density to raw readings:
+    // @param _rawOffset    raw = flux * _rawGain + _rawOffset, e.g. the
+    //                      sensitivity and offset of the ADC. The defaults
+    //                      compare flux density directly.
+    RawThresholdEngine(FunctionToPiecewise *_piecewise, float _rawGain = 1, float _rawOffset = 0);
+
+    // Adds a channel that actuates when the magnet comes closer than
+    // _actuationDistance and releases when it moves back past
+    // _releaseDistance.
+    //
+    // @param _actuationDistance    Distance at which the channel actuates
+    // @param _releaseDistance      Distance at which the channel releases,
+    //                              the difference to _actuationDistance is
+    //                              the hysteresis.
+    // @return                      The index of the new channel
+    int addChannel(float _actuationDistance, float _releaseDistance);
+
+    // Swaps the piecewise function, e.g. after a recalibration, and
+    // recalculates the raw thresholds of all channels. Must also be called
+    // with the same function after its knots were changed in place.
+    //
+    // @param _piecewise    The new piecewise function
+    void setPiecewise(FunctionToPiecewise *_piecewise);
+
+    // Checks one raw reading of every channel for actuations and releases.
+    //
+    // @param _raw      Array with one raw reading per channel
+    // @param _events   Array with room for one event per channel that
+    //                  receives the events
+    // @return          The number of events written to _events
+    int process(const float *_raw, Event *_events);
+
+    // @param _channel  The channel index
+    // @return          True if the channel is currently actuated
+    bool isActuated(int _channel) const;
+
+private:
+    FunctionToPiecewise *piecewise;
+    float rawGain;
+    float rawOffset;
+
+    std::vector<float> actuationDistances;
+    std::vector<float> releaseDistances;
+
+    // The raw thresholds are multiplied with direction so that a larger
+    // value always means a closer magnet, whichever way the raw reading
+    // changes with distance.
+    std::vector<float> direction;
+    std::vector<float> actuationThresholds;
+    std::vector<float> releaseThresholds;
+
+    std::vector<uint8_t> actuated;
+    std::vector<uint8_t> changed;
+
+    // Converts the distances of one channel to raw thresholds
+    //
+    // @param _channel  The channel index
+    void convertThresholds(int _channel);
+};
+
+RawThresholdEngine::RawThresholdEngine(FunctionToPiecewise *_piecewise, float _rawGain, float _rawOffset)
+{
+    piecewise = _piecewise;
+    rawGain = _rawGain;
+    rawOffset = _rawOffset;
+}
+
+int RawThresholdEngine::addChannel(float _actuationDistance, float _releaseDistance)
+{
+    if (_releaseDistance < _actuationDistance)
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "The release distance must not be closer than the actuation distance");
+    }
+
+    actuationDistances.push_back(_actuationDistance);
+    releaseDistances.push_back(_releaseDistance);
+    direction.push_back(1);
+    actuationThresholds.push_back(0);
+    releaseThresholds.push_back(0);
+    actuated.push_back(0);
+    changed.push_back(0);
+
+    int channel = actuated.size() - 1;
+    convertThresholds(channel);
+    return channel;
+}
+
+void RawThresholdEngine::setPiecewise(FunctionToPiecewise *_piecewise)
+{
+    piecewise = _piecewise;
+
+    for (size_t i = 0; i < actuated.size(); i++)
+    {
+        convertThresholds(i);
+    }
+}
+
+int RawThresholdEngine::process(const float *_raw, Event *_events)
+{
+    size_t nChannels = actuated.size();
+    const float *dir = direction.data();
+    const float *actuation = actuationThresholds.data();
+    const float *release = releaseThresholds.data();
+    uint8_t *state = actuated.data();
+    uint8_t *change = changed.data();
+
+    // Branchless so it vectorizes across channels
+    for (size_t i = 0; i < nChannels; i++)
+    {
+        float value = dir[i] * _raw[i];
+        uint8_t wasActuated = state[i];
+        uint8_t isActuated = (wasActuated & (value > release[i])) | (!wasActuated & (value >= actuation[i]));
+        change[i] = wasActuated ^ isActuated;
+        state[i] = isActuated;
+    }
+
+    int nEvents = 0;
+    for (size_t i = 0; i < nChannels; i++)
+    {
+        if (change[i])
+        {
+            _events[nEvents].channel = i;
+            _events[nEvents].actuated = state[i];
+            nEvents++;
+        }
+    }
+
+    return nEvents;
+}
+
+bool RawThresholdEngine::isActuated(int _channel) const
+{
+    return actuated[_channel];
+}
+
+void RawThresholdEngine::convertThresholds(int _channel)
+{
+    // A closer magnet must give a larger value after multiplying with
+    // direction. Taken from the slope of the table, not from the two
+    // thresholds, which are equal without hysteresis.
+    const std::vector<FunctionToPiecewise::Point> &knots = piecewise->getKnots();
+    bool rising = false;
+    bool falling = false;
+    for (size_t k = 0; k + 1 < knots.size(); k++)
+    {
+        rising |= knots[k + 1].y > knots[k].y;
+        falling |= knots[k + 1].y < knots[k].y;
+    }
+
+    if (rising == falling)
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "Raw thresholds need a monotonic, non-constant piecewise function");
+    }
+
+    // The batch lookup includes the end of the interval, like the kernels,
+    // and these setup lookups are not recorded to a QueryTrace
+    float distances[2] = {actuationDistances[_channel], releaseDistances[_channel]};
+    float flux[2];
+    piecewise->xToyBatch(distances, flux, 2);
+
+    float actuationRaw = flux[0] * rawGain + rawOffset;
+    float releaseRaw = flux[1] * rawGain + rawOffset;
+    float rawSlope = (knots.back().y - knots.front().y) * rawGain;
+    direction[_channel] = (rawSlope > 0) ? -1 : 1;
+    actuationThresholds[_channel] = direction[_channel] * actuationRaw;
+    releaseThresholds[_channel] = direction[_channel] * releaseRaw;
+}
+
+#endif //RAW_THRESHOLD_ENGINE_H
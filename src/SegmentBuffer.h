@@ -0,0 +1,305 @@
+// File: SegmentBuffer.h
+// Author: David Antaki
+// Date: 10/18/2026
+// License: Closed source
+//
+// Contents: Fixed size array that holds the flat segment data of a
+// FunctionToPiecewise. Random lookups in tables with millions of segments
+// miss the data TLB on almost every query with 4 KB pages, so on Linux
+// hosts large buffers can be backed by 2 MB huge pages instead:
+//
+//  - HEAP                  Plain heap memory, the default and the only
+//                          option on MCUs.
+//  - TRANSPARENT_HUGE_PAGES  A 2 MB aligned anonymous mapping marked with
+//                          madvise(MADV_HUGEPAGE). Only used if THP is not
+//                          disabled in /sys/kernel/mm/transparent_hugepage.
+//                          The kernel may still back parts with 4 KB pages
+//                          when no huge page is free, AnonHugePages in
+//                          /proc/self/smaps shows how much it got.
+//  - HUGETLBFS             Explicit huge pages with MAP_HUGETLB, which
+//                          need pages reserved in /proc/sys/vm/nr_hugepages.
+//
+// The policy is the preferred backing; if it cannot be had the next
+// weaker one is used, down to HEAP, and getBacking() tells which one a
+// buffer actually got. Buffers smaller than a huge page always use HEAP.
+// The policy may be changed while other threads allocate.
+// Only for trivially copyable element types.
+
+#ifndef SEGMENT_BUFFER_H
+#define SEGMENT_BUFFER_H
+
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <stdint.h>
+#include <atomic>
+#include "mbed.h"
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+class SegmentMemory
+{
+public:
+    enum Backing
+    {
+        HEAP,
+        TRANSPARENT_HUGE_PAGES,
+        HUGETLBFS
+    };
+
+    // One allocation and how to free it
+    typedef struct
+    {
+        void *data;
+        void *mapping;
+        size_t mappedBytes;
+        Backing backing;
+    } Allocation;
+
+    static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+    // Sets the preferred backing of buffers allocated from now on
+    //
+    // @param _policy   The preferred backing
+    static void setPolicy(Backing _policy);
+
+    // @return  The preferred backing
+    static Backing getPolicy();
+
+    // @param _backing  A backing
+    // @return          Its name for reports
+    static const char *name(Backing _backing);
+
+    // Allocates _bytes with the best backing available up to the policy
+    //
+    // @param _bytes    The number of bytes
+    // @return          The allocation
+    static Allocation allocate(size_t _bytes);
+
+    // Frees an allocation from allocate()
+    //
+    // @param _allocation   The allocation
+    static void release(const Allocation &_allocation);
+
+private:
+    static std::atomic<Backing> &policy();
+
+    // @return  True unless transparent huge pages are disabled system wide
+    static bool transparentHugePagesAllowed();
+};
+
+template <class T>
+class SegmentBuffer
+{
+public:
+    SegmentBuffer();
+    SegmentBuffer(const SegmentBuffer &_other);
+    SegmentBuffer &operator=(const SegmentBuffer &_other);
+    virtual ~SegmentBuffer();
+
+    // Reallocates the buffer for _n elements with the current policy.
+    // The contents are not kept.
+    //
+    // @param _n    The number of elements
+    void resize(size_t _n);
+
+    size_t size() const { return n; }
+    T *data() { return elements; }
+    const T *data() const { return elements; }
+    T &operator[](size_t _index) { return elements[_index]; }
+    const T &operator[](size_t _index) const { return elements[_index]; }
+
+    // @return  The backing the buffer actually got
+    SegmentMemory::Backing getBacking() const;
+
+private:
+    T *elements;
+    size_t n;
+    SegmentMemory::Allocation allocation;
+};
+
+const size_t SegmentMemory::HUGE_PAGE_SIZE;
+
+void SegmentMemory::setPolicy(Backing _policy)
+{
+    policy().store(_policy);
+}
+
+SegmentMemory::Backing SegmentMemory::getPolicy()
+{
+    return policy().load();
+}
+
+const char *SegmentMemory::name(Backing _backing)
+{
+    switch (_backing)
+    {
+    case TRANSPARENT_HUGE_PAGES:
+        return "transparent huge pages";
+    case HUGETLBFS:
+        return "hugetlbfs";
+    case HEAP:
+    default:
+        return "heap";
+    }
+}
+
+SegmentMemory::Allocation SegmentMemory::allocate(size_t _bytes)
+{
+    Allocation allocation;
+    allocation.mapping = nullptr;
+    allocation.mappedBytes = 0;
+    Backing preferred = policy().load();
+
+#if defined(__linux__)
+    if (_bytes >= HUGE_PAGE_SIZE)
+    {
+        // Whole huge pages only
+        size_t bytes = (_bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+
+#ifdef MAP_HUGETLB
+        if (preferred == HUGETLBFS)
+        {
+            void *mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (mapping != MAP_FAILED)
+            {
+                allocation.data = mapping;
+                allocation.mapping = mapping;
+                allocation.mappedBytes = bytes;
+                allocation.backing = HUGETLBFS;
+                return allocation;
+            }
+        }
+#endif
+
+#ifdef MADV_HUGEPAGE
+        if (preferred != HEAP && transparentHugePagesAllowed())
+        {
+            // Map one huge page more so the data can start on a huge page
+            // boundary, otherwise the kernel cannot use huge pages for it
+            size_t mappedBytes = bytes + HUGE_PAGE_SIZE;
+            void *mapping = mmap(nullptr, mappedBytes, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (mapping != MAP_FAILED)
+            {
+                uintptr_t aligned = ((uintptr_t)mapping + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1);
+
+                if (madvise((void *)aligned, bytes, MADV_HUGEPAGE) == 0)
+                {
+                    allocation.data = (void *)aligned;
+                    allocation.mapping = mapping;
+                    allocation.mappedBytes = mappedBytes;
+                    allocation.backing = TRANSPARENT_HUGE_PAGES;
+                    return allocation;
+                }
+
+                munmap(mapping, mappedBytes);
+            }
+        }
+#endif
+    }
+#endif
+
+    allocation.data = malloc(_bytes > 0 ? _bytes : 1);
+    allocation.backing = HEAP;
+
+    if (allocation.data == nullptr)
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_OUT_OF_MEMORY), "Out of memory for segment buffer");
+    }
+
+    return allocation;
+}
+
+void SegmentMemory::release(const Allocation &_allocation)
+{
+    if (_allocation.backing == HEAP)
+    {
+        free(_allocation.data);
+        return;
+    }
+
+#if defined(__linux__)
+    munmap(_allocation.mapping, _allocation.mappedBytes);
+#endif
+}
+
+std::atomic<SegmentMemory::Backing> &SegmentMemory::policy()
+{
+    static std::atomic<Backing> preferred(HEAP);
+    return preferred;
+}
+
+bool SegmentMemory::transparentHugePagesAllowed()
+{
+#if defined(__linux__)
+    // Read once, the mode is "always", "madvise" or "never" with the
+    // active one in brackets
+    static const bool allowed = []() {
+        char mode[128] = {0};
+        FILE *file = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+        if (file == nullptr)
+            return false;
+        bool ok = fgets(mode, sizeof(mode), file) != nullptr;
+        fclose(file);
+        return ok && strstr(mode, "[never]") == nullptr;
+    }();
+    return allowed;
+#else
+    return false;
+#endif
+}
+
+template <class T>
+SegmentBuffer<T>::SegmentBuffer()
+{
+    n = 0;
+    allocation = SegmentMemory::allocate(0);
+    elements = (T *)allocation.data;
+}
+
+template <class T>
+SegmentBuffer<T>::SegmentBuffer(const SegmentBuffer &_other)
+{
+    n = 0;
+    allocation = SegmentMemory::allocate(0);
+    elements = (T *)allocation.data;
+    *this = _other;
+}
+
+template <class T>
+SegmentBuffer<T> &SegmentBuffer<T>::operator=(const SegmentBuffer &_other)
+{
+    if (this != &_other)
+    {
+        resize(_other.n);
+        memcpy(elements, _other.elements, n * sizeof(T));
+    }
+    return *this;
+}
+
+template <class T>
+SegmentBuffer<T>::~SegmentBuffer()
+{
+    SegmentMemory::release(allocation);
+}
+
+template <class T>
+void SegmentBuffer<T>::resize(size_t _n)
+{
+    SegmentMemory::release(allocation);
+    allocation = SegmentMemory::allocate(_n * sizeof(T));
+    elements = (T *)allocation.data;
+    n = _n;
+}
+
+template <class T>
+SegmentMemory::Backing SegmentBuffer<T>::getBacking() const
+{
+    return allocation.backing;
+}
+
+#endif //SEGMENT_BUFFER_H
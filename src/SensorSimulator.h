@@ -0,0 +1,254 @@
+// File: SensorSimulator.h
+// Author: David Antaki
+// Date: 10/18/2026
+// License: Closed source
+//
+// Contents: Generates synthetic raw sensor streams for end-to-end tests
+// and benchmarks without hardware. The magnet follows a motion profile:
+//
+//  - KEY_PRESS     Rest, travel down, hold, travel up, rest again, once
+//                  per period. The travel is eased in and out.
+//  - OSCILLATION   Sine around a center position.
+//  - RANDOM_WALK   Gaussian steps, reflected at the bounds.
+//
+// Every position goes through the sensor function (e.g. Func2), then
+// Gaussian noise is added and the result is quantized by an ADC with a
+// configurable resolution and full scale. Samples are taken at a fixed
+// rate. The output stream is in sensor units, ready for yToxBatch(), and
+// the true positions can be returned alongside to validate the result.
+
+#ifndef SENSOR_SIMULATOR_H
+#define SENSOR_SIMULATOR_H
+
+#include <stdint.h>
+#include <cmath>
+#include <random>
+#include "mbed.h"
+
+class SensorSimulator
+{
+public:
+    enum Profile
+    {
+        KEY_PRESS,
+        OSCILLATION,
+        RANDOM_WALK
+    };
+
+    // @param float (*_sensor)(float)   Sensor output over magnet position
+    // @param _sampleRate   Samples per second
+    // @param _seed         Seed of the noise and the random walk, the same
+    //                      seed gives the same stream
+    SensorSimulator(float (*_sensor)(float), float _sampleRate, uint32_t _seed = 1);
+
+    // Presses a key once every _period seconds
+    //
+    // @param _rest         The position when released
+    // @param _bottom       The position when fully pressed
+    // @param _travelTime   Seconds to travel from rest to bottom, and the
+    //                      same back
+    // @param _holdTime     Seconds held at the bottom
+    // @param _period       Seconds from one press to the next
+    void setKeyPress(float _rest, float _bottom, float _travelTime, float _holdTime, float _period);
+
+    // @param _center       The center position
+    // @param _amplitude    The largest distance from the center
+    // @param _frequency    Oscillations per second
+    void setOscillation(float _center, float _amplitude, float _frequency);
+
+    // @param _start        The start position
+    // @param _stepSize     Standard deviation of one step per sample
+    // @param _min          The lowest position
+    // @param _max          The highest position
+    void setRandomWalk(float _start, float _stepSize, float _min, float _max);
+
+    // @param _stdDev       Standard deviation of the sensor noise, in
+    //                      sensor units. 0 for none.
+    void setNoise(float _stdDev);
+
+    // @param _bits         ADC resolution, 0 for no quantization
+    // @param _fullScale    The sensor value of the highest ADC code, the
+    //                      lowest code is 0. Values are clipped to it.
+    void setAdc(int _bits, float _fullScale);
+
+    // Generates the next _n samples of the stream
+    //
+    // @param _raw          Array that receives the _n sensor values
+    // @param _n            The number of samples
+    // @param _positions    Array that receives the _n true positions,
+    //                      or nullptr
+    void generate(float *_raw, size_t _n, float *_positions = nullptr);
+
+    // @return  The time of the next sample in seconds
+    double getTime() const;
+
+private:
+    float (*sensor)(float);
+    float sampleRate;
+    uint64_t nSamples;
+
+    Profile profile;
+    float rest, bottom, travelTime, holdTime, period;
+    float center, amplitude, frequency;
+    float walkPosition, stepSize, walkMin, walkMax;
+
+    float noiseStdDev;
+    int adcBits;
+    float adcFullScale;
+
+    std::mt19937 random;
+    std::normal_distribution<float> normal;
+
+    // @return  The magnet position at the next sample
+    float nextPosition();
+};
+
+SensorSimulator::SensorSimulator(float (*_sensor)(float), float _sampleRate, uint32_t _seed)
+    : random(_seed), normal(0, 1)
+{
+    if (_sensor == nullptr || !(_sampleRate > 0))
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "Invalid sensor function or sample rate for the simulator");
+    }
+
+    sensor = _sensor;
+    sampleRate = _sampleRate;
+    nSamples = 0;
+
+    noiseStdDev = 0;
+    adcBits = 0;
+    adcFullScale = 0;
+
+    setOscillation(0, 0, 0);
+}
+
+void SensorSimulator::setKeyPress(float _rest, float _bottom, float _travelTime, float _holdTime, float _period)
+{
+    if (!(_travelTime > 0) || _holdTime < 0 || !(_period >= 2 * _travelTime + _holdTime))
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "A key press must fit into its period");
+    }
+
+    profile = KEY_PRESS;
+    rest = _rest;
+    bottom = _bottom;
+    travelTime = _travelTime;
+    holdTime = _holdTime;
+    period = _period;
+}
+
+void SensorSimulator::setOscillation(float _center, float _amplitude, float _frequency)
+{
+    profile = OSCILLATION;
+    center = _center;
+    amplitude = _amplitude;
+    frequency = _frequency;
+}
+
+void SensorSimulator::setRandomWalk(float _start, float _stepSize, float _min, float _max)
+{
+    if (!(_max > _min) || _start < _min || _start > _max || _stepSize < 0)
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "Invalid bounds or step size of the random walk");
+    }
+
+    profile = RANDOM_WALK;
+    walkPosition = _start;
+    stepSize = _stepSize;
+    walkMin = _min;
+    walkMax = _max;
+}
+
+void SensorSimulator::setNoise(float _stdDev)
+{
+    noiseStdDev = _stdDev;
+}
+
+void SensorSimulator::setAdc(int _bits, float _fullScale)
+{
+    if (_bits < 0 || _bits > 24 || (_bits > 0 && !(_fullScale > 0)))
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "Invalid ADC resolution or full scale");
+    }
+
+    adcBits = _bits;
+    adcFullScale = _fullScale;
+}
+
+void SensorSimulator::generate(float *_raw, size_t _n, float *_positions)
+{
+    float maxCode = (float)((1L << adcBits) - 1);
+    float lsb = (adcBits > 0) ? adcFullScale / maxCode : 0;
+
+    for (size_t i = 0; i < _n; i++)
+    {
+        float position = nextPosition();
+        float value = (*sensor)(position);
+
+        if (noiseStdDev > 0)
+            value += noiseStdDev * normal(random);
+
+        if (adcBits > 0)
+        {
+            float code = roundf(value / lsb);
+            code = (code < 0) ? 0 : ((code > maxCode) ? maxCode : code);
+            value = code * lsb;
+        }
+
+        _raw[i] = value;
+        if (_positions != nullptr)
+            _positions[i] = position;
+    }
+}
+
+double SensorSimulator::getTime() const
+{
+    return nSamples / (double)sampleRate;
+}
+
+float SensorSimulator::nextPosition()
+{
+    double time = getTime();
+    nSamples++;
+
+    switch (profile)
+    {
+    case KEY_PRESS:
+    {
+        float t = (float)fmod(time, (double)period);
+        float travel;
+
+        if (t < travelTime)
+            travel = t / travelTime;
+        else if (t < travelTime + holdTime)
+            travel = 1;
+        else if (t < 2 * travelTime + holdTime)
+            travel = 1 - (t - travelTime - holdTime) / travelTime;
+        else
+            travel = 0;
+
+        // Ease in and out (smoothstep)
+        travel = travel * travel * (3 - 2 * travel);
+        return rest + (bottom - rest) * travel;
+    }
+
+    case RANDOM_WALK:
+    {
+        walkPosition += stepSize * normal(random);
+
+        // Reflect at the bounds
+        if (walkPosition < walkMin)
+            walkPosition = 2 * walkMin - walkPosition;
+        if (walkPosition > walkMax)
+            walkPosition = 2 * walkMax - walkPosition;
+        walkPosition = (walkPosition < walkMin) ? walkMin : ((walkPosition > walkMax) ? walkMax : walkPosition);
+        return walkPosition;
+    }
+
+    case OSCILLATION:
+    default:
+        return center + amplitude * (float)sin(2 * M_PI * frequency * time);
+    }
+}
+
+#endif //SENSOR_SIMULATOR_H
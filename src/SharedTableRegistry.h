@@ -0,0 +1,434 @@
+// File: SharedTableRegistry.h
+// Author: David Antaki
+// Date: 10/18/2026
+// License: Closed source
+//
+// Contents: Shares built tables between the processes of a Linux host
+// through POSIX shared memory, so a table is built once per host and its
+// memory is not duplicated in every process. A table is published under a
+// name in two shared memory objects:
+//
+//  - "/name"       Control block with the current version, atomic.
+//  - "/name.vN"    The flat knots and segments of version N, read-only
+//                  once published.
+//
+// publish() writes a new version in full and then switches the current
+// version atomically, so a reader never sees a half-written table. The
+// previous version is unlinked: processes that still have it attached keep
+// using it until they re-attach. SharedTable attaches read-only and runs
+// the batch kernels directly on the shared arrays. Shared memory is
+// external data, so a table with an unknown format is refused, not
+// trusted. remove() also sweeps versions left behind by publishers that
+// crashed. On other platforms nothing can be published or attached.
+
+#ifndef SHARED_TABLE_REGISTRY_H
+#define SHARED_TABLE_REGISTRY_H
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "mbed.h"
+#include "FunctionToPiecewise.h"
+#include "KernelDispatch.h"
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+
+// The control block is shared between processes, which only works for
+// lock-free atomics
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && sizeof(unsigned long long) == sizeof(uint64_t),
+              "Shared tables need lock-free 64 bit atomics");
+#endif
+
+class SharedTableRegistry
+{
+public:
+    // Longest table name
+    static const size_t MAX_NAME_LENGTH = 200;
+
+    // Publishes a table as the new current version of _name
+    //
+    // @param _name     The name, without '/'
+    // @param _table    The table
+    // @return          The version it was published as
+    static uint64_t publish(const char *_name, const FunctionToPiecewise &_table);
+
+    // Unlinks all versions and the control block of _name, including
+    // versions that crashed publishers left behind. Attached processes
+    // keep their mappings.
+    //
+    // @param _name     The name
+    static void remove(const char *_name);
+
+private:
+    friend class SharedTable;
+
+    typedef struct
+    {
+        // The version readers attach to, 0 if none
+        std::atomic<uint64_t> current;
+        // The last version handed out to a publisher
+        std::atomic<uint64_t> last;
+    } Control;
+
+    // Start of every table object, followed by knotXs, knotYs, xSegments
+    // and ySegments
+    typedef struct
+    {
+        char magic[4];
+        uint32_t format;
+        uint64_t version;
+        uint64_t nSegments;
+        // 1 if rising, -1 if falling, 0 if not monotonic
+        float ySign;
+        uint32_t reserved;
+    } Header;
+
+    static const uint32_t FORMAT = 1;
+
+    // @return  The object name of the control block or of one version
+    static std::vector<char> objectName(const char *_name, uint64_t _version);
+
+    // @return  The bytes of a table object with _nSegments segments
+    static size_t tableBytes(uint64_t _nSegments);
+};
+
+// A published table attached read-only
+class SharedTable
+{
+public:
+    SharedTable();
+    virtual ~SharedTable();
+
+    // Attaches the current version of _name, detaching any previous one
+    //
+    // @param _name     The name
+    // @return          False if nothing is published under _name or the
+    //                  table has an unknown format, version or an
+    //                  invalid header
+    bool attach(const char *_name);
+
+    // Unmaps the table
+    void detach();
+
+    bool isAttached() const;
+
+    // @return  The attached version
+    uint64_t getVersion() const;
+
+    // @return  True if a newer version was published since attach()
+    bool isStale() const;
+
+    // @return  The number of segments
+    size_t getSegmentCount() const;
+
+    // Like FunctionToPiecewise::xToyBatch(), in place on the shared table
+    void xToyBatch(const float *_x, float *_y, size_t _n) const;
+
+    // Like FunctionToPiecewise::yToxBatch(). Only for monotonic tables.
+    void yToxBatch(const float *_y, float *_x, size_t _n) const;
+
+private:
+    // Not copyable, it owns the mappings
+    SharedTable(const SharedTable &);
+    SharedTable &operator=(const SharedTable &);
+
+    const SharedTableRegistry::Control *control;
+    const SharedTableRegistry::Header *header;
+    size_t tableBytes;
+
+    const float *knotXs;
+    const float *knotYs;
+    const FunctionToPiecewise::LineFunc *xSegments;
+    const FunctionToPiecewise::LineFunc *ySegments;
+};
+
+const size_t SharedTableRegistry::MAX_NAME_LENGTH;
+const uint32_t SharedTableRegistry::FORMAT;
+
+uint64_t SharedTableRegistry::publish(const char *_name, const FunctionToPiecewise &_table)
+{
+#if defined(__linux__)
+    std::vector<char> controlName = objectName(_name, 0);
+    int controlFd = shm_open(controlName.data(), O_RDWR | O_CREAT, 0644);
+    if (controlFd < 0 || ftruncate(controlFd, sizeof(Control)) != 0)
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_OUT_OF_MEMORY), "Cannot create the shared table control block");
+    }
+
+    // A new control block is zero filled: no version yet
+    Control *control = (Control *)mmap(nullptr, sizeof(Control), PROT_READ | PROT_WRITE, MAP_SHARED, controlFd, 0);
+    close(controlFd);
+    if (control == MAP_FAILED)
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_OUT_OF_MEMORY), "Cannot map the shared table control block");
+    }
+
+    uint64_t version = control->last.fetch_add(1) + 1;
+
+    // Write the whole table into a new object
+    const std::vector<FunctionToPiecewise::Point> &knots = _table.getKnots();
+    uint64_t nSegments = knots.size() - 1;
+    size_t bytes = tableBytes(nSegments);
+
+    std::vector<char> tableName = objectName(_name, version);
+    int tableFd = shm_open(tableName.data(), O_RDWR | O_CREAT | O_EXCL, 0444);
+    if (tableFd < 0 || ftruncate(tableFd, bytes) != 0)
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_OUT_OF_MEMORY), "Cannot create the shared table");
+    }
+
+    char *mapping = (char *)mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, tableFd, 0);
+    close(tableFd);
+    if (mapping == MAP_FAILED)
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_OUT_OF_MEMORY), "Cannot map the shared table");
+    }
+
+    Header *header = (Header *)mapping;
+    float *knotXs = (float *)(mapping + sizeof(Header));
+    float *knotYs = knotXs + nSegments + 1;
+    FunctionToPiecewise::LineFunc *xSegments = (FunctionToPiecewise::LineFunc *)(knotYs + nSegments + 1);
+    FunctionToPiecewise::LineFunc *ySegments = xSegments + nSegments;
+
+    bool rising = false;
+    bool falling = false;
+    for (size_t i = 0; i < knots.size(); i++)
+    {
+        knotXs[i] = knots[i].x;
+        knotYs[i] = knots[i].y;
+        if (i > 0)
+        {
+            rising |= knots[i].y > knots[i - 1].y;
+            falling |= knots[i].y < knots[i - 1].y;
+        }
+    }
+    KernelDispatch<FunctionToPiecewise::LineFunc>::build()(knotXs, knotYs, xSegments, ySegments, nSegments);
+
+    memcpy(header->magic, "FTPS", 4);
+    header->format = FORMAT;
+    header->version = version;
+    header->nSegments = nSegments;
+    header->ySign = (rising && falling) ? 0 : (falling ? -1 : 1);
+    header->reserved = 0;
+    munmap(mapping, bytes);
+
+    // Switch readers over, unless a concurrent publisher got further
+    uint64_t previous = control->current.load();
+    while (previous < version && !control->current.compare_exchange_weak(previous, version))
+    {
+    }
+    munmap(control, sizeof(Control));
+
+    // The replaced version stays mapped by the processes that use it
+    if (previous != 0)
+    {
+        std::vector<char> previousName = objectName(_name, std::min(previous, version));
+        shm_unlink(previousName.data());
+    }
+
+    return version;
+#else
+    MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_UNSUPPORTED), "Shared tables need POSIX shared memory");
+    return 0;
+#endif
+}
+
+void SharedTableRegistry::remove(const char *_name)
+{
+#if defined(__linux__)
+    std::vector<char> controlName = objectName(_name, 0);
+    shm_unlink(controlName.data());
+
+    // Every "name.vN" object, not only the current version: a publisher
+    // that crashed between creating its version and switching to it left
+    // one behind. POSIX shared memory objects live in /dev/shm on Linux.
+    DIR *directory = opendir("/dev/shm");
+    if (directory == nullptr)
+        return;
+
+    size_t nameLength = strlen(_name);
+    struct dirent *entry;
+    while ((entry = readdir(directory)) != nullptr)
+    {
+        const char *version = entry->d_name + nameLength;
+        if (strncmp(entry->d_name, _name, nameLength) != 0 || strncmp(version, ".v", 2) != 0 ||
+            version[2] == '\0' || strspn(version + 2, "0123456789") != strlen(version + 2))
+        {
+            continue;
+        }
+
+        std::vector<char> tableName = objectName(_name, strtoull(version + 2, nullptr, 10));
+        shm_unlink(tableName.data());
+    }
+
+    closedir(directory);
+#endif
+}
+
+std::vector<char> SharedTableRegistry::objectName(const char *_name, uint64_t _version)
+{
+    if (_name == nullptr || _name[0] == '\0' || strlen(_name) > MAX_NAME_LENGTH || strchr(_name, '/') != nullptr)
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "Invalid shared table name");
+    }
+
+    std::vector<char> name(MAX_NAME_LENGTH + 32);
+    if (_version == 0)
+        snprintf(name.data(), name.size(), "/%s", _name);
+    else
+        snprintf(name.data(), name.size(), "/%s.v%llu", _name, (unsigned long long)_version);
+    return name;
+}
+
+size_t SharedTableRegistry::tableBytes(uint64_t _nSegments)
+{
+    return sizeof(Header) + 2 * (_nSegments + 1) * sizeof(float) +
+           2 * _nSegments * sizeof(FunctionToPiecewise::LineFunc);
+}
+
+SharedTable::SharedTable()
+{
+    control = nullptr;
+    header = nullptr;
+    tableBytes = 0;
+    knotXs = knotYs = nullptr;
+    xSegments = ySegments = nullptr;
+}
+
+SharedTable::~SharedTable()
+{
+    detach();
+}
+
+bool SharedTable::attach(const char *_name)
+{
+    detach();
+
+#if defined(__linux__)
+    std::vector<char> controlName = SharedTableRegistry::objectName(_name, 0);
+    int controlFd = shm_open(controlName.data(), O_RDONLY, 0);
+    if (controlFd < 0)
+        return false;
+
+    void *controlMapping = mmap(nullptr, sizeof(SharedTableRegistry::Control), PROT_READ, MAP_SHARED, controlFd, 0);
+    close(controlFd);
+    if (controlMapping == MAP_FAILED)
+        return false;
+    control = (const SharedTableRegistry::Control *)controlMapping;
+
+    // A publisher may unlink the version just read before it is opened,
+    // then the newer version is tried
+    for (int attempt = 0; attempt < 8; attempt++)
+    {
+        uint64_t version = control->current.load();
+        if (version == 0)
+            break;
+
+        std::vector<char> tableName = SharedTableRegistry::objectName(_name, version);
+        int tableFd = shm_open(tableName.data(), O_RDONLY, 0);
+        if (tableFd < 0)
+            continue;
+
+        struct stat status;
+        if (fstat(tableFd, &status) != 0 || (size_t)status.st_size < sizeof(SharedTableRegistry::Header))
+        {
+            close(tableFd);
+            continue;
+        }
+
+        void *mapping = mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, tableFd, 0);
+        close(tableFd);
+        if (mapping == MAP_FAILED)
+            continue;
+
+        header = (const SharedTableRegistry::Header *)mapping;
+        tableBytes = status.st_size;
+
+        if (memcmp(header->magic, "FTPS", 4) != 0 || header->format != SharedTableRegistry::FORMAT ||
+            header->version != version || header->nSegments < 1 ||
+            !(header->ySign == 1 || header->ySign == -1 || header->ySign == 0) ||
+            tableBytes != SharedTableRegistry::tableBytes(header->nSegments))
+        {
+            break;
+        }
+
+        size_t nSegments = header->nSegments;
+        knotXs = (const float *)((const char *)mapping + sizeof(SharedTableRegistry::Header));
+        knotYs = knotXs + nSegments + 1;
+        xSegments = (const FunctionToPiecewise::LineFunc *)(knotYs + nSegments + 1);
+        ySegments = xSegments + nSegments;
+        return true;
+    }
+
+    detach();
+#endif
+    return false;
+}
+
+void SharedTable::detach()
+{
+#if defined(__linux__)
+    if (header != nullptr)
+        munmap((void *)header, tableBytes);
+    if (control != nullptr)
+        munmap((void *)control, sizeof(SharedTableRegistry::Control));
+#endif
+
+    control = nullptr;
+    header = nullptr;
+    tableBytes = 0;
+    knotXs = knotYs = nullptr;
+    xSegments = ySegments = nullptr;
+}
+
+bool SharedTable::isAttached() const
+{
+    return header != nullptr;
+}
+
+uint64_t SharedTable::getVersion() const
+{
+    return isAttached() ? header->version : 0;
+}
+
+bool SharedTable::isStale() const
+{
+    return isAttached() && control->current.load() != header->version;
+}
+
+size_t SharedTable::getSegmentCount() const
+{
+    return isAttached() ? header->nSegments : 0;
+}
+
+void SharedTable::xToyBatch(const float *_x, float *_y, size_t _n) const
+{
+    if (!isAttached())
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "No shared table is attached");
+    }
+
+    KernelDispatch<FunctionToPiecewise::LineFunc>::lookup()(knotXs, xSegments, header->nSegments, 1, 1, 0, 1, 0,
+                                                            _x, sizeof(float), _y, sizeof(float), _n, nullptr);
+}
+
+void SharedTable::yToxBatch(const float *_y, float *_x, size_t _n) const
+{
+    if (!isAttached() || header->ySign == 0)
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "No shared table is attached or it is not monotonic");
+    }
+
+    KernelDispatch<FunctionToPiecewise::LineFunc>::lookup()(knotYs, ySegments, header->nSegments, header->ySign, 1, 0, 1, 0,
+                                                            _y, sizeof(float), _x, sizeof(float), _n, nullptr);
+}
+
+#endif //SHARED_TABLE_REGISTRY_H
@@ -0,0 +1,204 @@
+// File: StreamingPiecewiseFit.h
+// Author: David Antaki
+// Date: 10/18/2026
+// License: Closed source
+//
+// Contents: Least-squares fit of calibration captures that are too large
+// to hold in memory. The samples are read once, in chunks, and only the
+// sufficient statistics of every fine bin are kept: the number of samples
+// and the sums of u, u^2, y and u*y, with u the position of a sample inside
+// its bin. Memory is bounded by the number of bins, not by the number of
+// samples. After the pass, fit() turns the bin statistics into the normal
+// equations of PiecewiseLeastSquares for any number of segments that
+// divides the number of bins, so several table sizes can be tried without
+// reading the capture again.
+
+#ifndef STREAMING_PIECEWISE_FIT_H
+#define STREAMING_PIECEWISE_FIT_H
+
+#include <vector>
+#include <cstdio>
+#include "mbed.h"
+#include "FunctionToPiecewise.h"
+#include "PiecewiseLeastSquares.h"
+
+class StreamingPiecewiseFit
+{
+public:
+    // @param _nBins        The number of fine bins. The fitted number of
+    //                      segments must divide it.
+    // @param _interval     The interval along the x-axis that is fitted.
+    //                      Samples outside of it are ignored.
+    StreamingPiecewiseFit(int _nBins, std::pair<float, float> _interval);
+
+    // Adds _n samples to the bin statistics.
+    //
+    // @param _x    Array of _n x values
+    // @param _y    Array of _n measured y values
+    // @param _n    The number of samples
+    void addSamples(const float *_x, const float *_y, size_t _n);
+
+    // Reads samples stored as interleaved binary float pairs (x, y) until
+    // the end of the file, _chunkSize samples at a time.
+    //
+    // @param _file         The open file
+    // @param _chunkSize    The number of samples read at once
+    // @return              The number of samples read
+    size_t read(FILE *_file, size_t _chunkSize = 4096);
+
+    // @return  The number of samples inside of the interval so far
+    size_t getSampleCount() const;
+
+    // Fits the knots of _nSegments segments to the samples added so far.
+    //
+    // @param _nSegments    The number of segments, must divide the number
+    //                      of bins
+    // @param _monotonic    See PiecewiseLeastSquares
+    // @param _smoothing    See PiecewiseLeastSquares
+    // @return              The fitted knots sorted by ascending x.
+    std::vector<FunctionToPiecewise::Point> fitKnots(int _nSegments,
+                                                     PiecewiseLeastSquares::Monotonicity _monotonic = PiecewiseLeastSquares::NONE,
+                                                     float _smoothing = 1e-4);
+
+    // Fits a piecewise function, like fitKnots().
+    FunctionToPiecewise fit(int _nSegments,
+                            PiecewiseLeastSquares::Monotonicity _monotonic = PiecewiseLeastSquares::NONE,
+                            float _smoothing = 1e-4);
+
+private:
+    // Sufficient statistics of one fine bin
+    typedef struct
+    {
+        double n;
+        double sumU;
+        double sumUU;
+        double sumY;
+        double sumUY;
+    } Moments;
+
+    int nBins;
+    std::pair<float, float> interval;
+    double binWidth;
+
+    std::vector<Moments> bins;
+
+    // Read buffer of read(), reused between calls
+    std::vector<float> chunk;
+};
+
+StreamingPiecewiseFit::StreamingPiecewiseFit(int _nBins, std::pair<float, float> _interval)
+{
+    if (_nBins < 1 || !(_interval.second > _interval.first))
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "Invalid number of bins or interval for the streaming fit");
+    }
+
+    nBins = _nBins;
+    interval = _interval;
+    binWidth = ((double)_interval.second - _interval.first) / _nBins;
+
+    Moments empty = {0, 0, 0, 0, 0};
+    bins.assign(_nBins, empty);
+}
+
+void StreamingPiecewiseFit::addSamples(const float *_x, const float *_y, size_t _n)
+{
+    for (size_t i = 0; i < _n; i++)
+    {
+        if (!(_x[i] >= interval.first && _x[i] <= interval.second))
+            continue;
+
+        double pos = (_x[i] - (double)interval.first) / binWidth;
+        int bin = (int)pos;
+        if (bin >= nBins)
+            bin = nBins - 1;
+
+        double u = pos - bin;
+        double y = _y[i];
+        Moments &moments = bins[bin];
+        moments.n += 1;
+        moments.sumU += u;
+        moments.sumUU += u * u;
+        moments.sumY += y;
+        moments.sumUY += u * y;
+    }
+}
+
+size_t StreamingPiecewiseFit::read(FILE *_file, size_t _chunkSize)
+{
+    if (_file == nullptr || _chunkSize < 1)
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "Invalid file or chunk size for the streaming fit");
+    }
+
+    chunk.resize(2 * _chunkSize);
+    std::vector<float> xs(_chunkSize);
+    std::vector<float> ys(_chunkSize);
+    size_t total = 0;
+
+    for (;;)
+    {
+        size_t n = fread(chunk.data(), 2 * sizeof(float), _chunkSize, _file);
+        if (n == 0)
+            break;
+
+        // De-interleave so the chunk goes through addSamples()
+        for (size_t i = 0; i < n; i++)
+        {
+            xs[i] = chunk[2 * i];
+            ys[i] = chunk[2 * i + 1];
+        }
+        addSamples(xs.data(), ys.data(), n);
+        total += n;
+    }
+
+    return total;
+}
+
+size_t StreamingPiecewiseFit::getSampleCount() const
+{
+    size_t count = 0;
+    for (int j = 0; j < nBins; j++)
+        count += (size_t)bins[j].n;
+    return count;
+}
+
+std::vector<FunctionToPiecewise::Point> StreamingPiecewiseFit::fitKnots(int _nSegments,
+                                                                        PiecewiseLeastSquares::Monotonicity _monotonic,
+                                                                        float _smoothing)
+{
+    if (_nSegments < 1 || nBins % _nSegments != 0)
+    {
+        MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_INVALID_ARGUMENT), "The number of segments must divide the number of bins");
+    }
+
+    PiecewiseLeastSquares fitter(_nSegments, interval, _monotonic, _smoothing);
+    int binsPerSegment = nBins / _nSegments;
+    double r = binsPerSegment;
+
+    for (int j = 0; j < nBins; j++)
+    {
+        const Moments &m = bins[j];
+        if (m.n == 0)
+            continue;
+
+        // A sample at u in bin j sits at t = (offset + u) / r in its segment
+        int segment = j / binsPerSegment;
+        double offset = j % binsPerSegment;
+        double sumT = (offset * m.n + m.sumU) / r;
+        double sumTT = (offset * offset * m.n + 2 * offset * m.sumU + m.sumUU) / (r * r);
+        double sumTY = (offset * m.sumY + m.sumUY) / r;
+
+        fitter.addMoments(segment, m.n, sumT, sumTT, m.sumY, sumTY);
+    }
+
+    return fitter.fitKnots();
+}
+
+FunctionToPiecewise StreamingPiecewiseFit::fit(int _nSegments, PiecewiseLeastSquares::Monotonicity _monotonic,
+                                               float _smoothing)
+{
+    return FunctionToPiecewise(fitKnots(_nSegments, _monotonic, _smoothing));
+}
+
+#endif //STREAMING_PIECEWISE_FIT_H
@@ -0,0 +1,89 @@
+// File: StridedView.h
+// Author: David Antaki
+// Date: 10/18/2026
+// License: Closed source
+//
+// Contents: Views of floats that are spread out in memory with a fixed
+// byte stride, e.g. one field of an array of acquisition frames. The batch
+// conversions of FunctionToPiecewise read their inputs and write their
+// outputs through these views directly, so a frame's flux can be turned
+// into a distance stored in the same frame without copying the fields into
+// and out of temporary float arrays. A plain float array is a view with a
+// stride of sizeof(float).
+
+#ifndef STRIDED_VIEW_H
+#define STRIDED_VIEW_H
+
+#include <stddef.h>
+
+// Writable view
+class StridedView
+{
+public:
+    // @param _first    The first float
+    // @param _stride   Bytes from one float to the next
+    explicit StridedView(float *_first, size_t _stride = sizeof(float))
+    {
+        first = _first;
+        stride = _stride;
+    }
+
+    // View of one float field of an array of structs
+    //
+    // @param _frames   The first struct
+    // @param _field    The field, e.g. &Frame::flux
+    // @return          The view
+    template <class Frame>
+    static StridedView field(Frame *_frames, float Frame::*_field)
+    {
+        return StridedView(&(_frames->*_field), sizeof(Frame));
+    }
+
+    float &operator[](size_t _index) const
+    {
+        return *(float *)((char *)first + _index * stride);
+    }
+
+    float *first;
+    size_t stride;
+};
+
+// Read-only view
+class ConstStridedView
+{
+public:
+    // @param _first    The first float
+    // @param _stride   Bytes from one float to the next
+    explicit ConstStridedView(const float *_first, size_t _stride = sizeof(float))
+    {
+        first = _first;
+        stride = _stride;
+    }
+
+    ConstStridedView(const StridedView &_view)
+    {
+        first = _view.first;
+        stride = _view.stride;
+    }
+
+    // View of one float field of an array of structs
+    //
+    // @param _frames   The first struct
+    // @param _field    The field, e.g. &Frame::flux
+    // @return          The view
+    template <class Frame>
+    static ConstStridedView field(const Frame *_frames, float Frame::*_field)
+    {
+        return ConstStridedView(&(_frames->*_field), sizeof(Frame));
+    }
+
+    const float &operator[](size_t _index) const
+    {
+        return *(const float *)((const char *)first + _index * stride);
+    }
+
+    const float *first;
+    size_t stride;
+};
+
+#endif //STRIDED_VIEW_H
@@ -0,0 +1,196 @@
+// File: TraceReplay.h
+// Author: David Antaki
+// Date: 10/18/2026
+// License: Closed source
+//
+// Contents: Host benchmark runner that replays a QueryTrace recorded from
+// production traffic against any lookup engine, e.g. a FunctionToPiecewise
+// built with a different number of segments, and reports throughput and
+// latency. An engine is anything with float xToy(float) and
+// float yTox(float) methods.
+//
+// Throughput is measured over the whole trace in one go. Latency is then
+// measured per query in a second pass, minus the overhead of reading the
+// clock, and reported as mean, median, 99th percentile and maximum.
+// Hardware counters (see PerfCounters.h) are read around the throughput
+// pass and reported per lookup, or as n/a where they are unavailable.
+// Counts that were scaled because the kernel multiplexed the counters are
+// marked as such.
+
+#ifndef TRACE_REPLAY_H
+#define TRACE_REPLAY_H
+
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include "mbed.h"
+#include "Printer.h"
+#include "QueryTrace.h"
+#include "PerfCounters.h"
+
+class TraceReplay
+{
+public:
+    typedef struct
+    {
+        size_t nQueries;
+        double seconds;
+        double queriesPerSecond;
+        float meanNs;
+        float medianNs;
+        float p99Ns;
+        float maxNs;
+
+        // Hardware counters per lookup, negative if unavailable
+        double perLookup[PerfCounters::N_COUNTERS];
+
+        // True if a counter was multiplexed and its value is scaled
+        bool scaled[PerfCounters::N_COUNTERS];
+    } Result;
+
+    // @param _trace    The trace to replay
+    TraceReplay(const QueryTrace &_trace);
+
+    // Replays the trace against an engine
+    //
+    // @param _engine       The engine to benchmark
+    // @param _repetitions  How often the trace is replayed for the
+    //                      throughput measurement
+    // @return              Throughput and latency of the engine
+    template <class Engine>
+    Result run(Engine &_engine, int _repetitions = 1);
+
+    // Prints one result as a line of text
+    //
+    // @param _name     Name of the engine or configuration
+    // @param _result   The result of run()
+    static void print(const char *_name, const Result &_result);
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    // The trace decoded up front so decoding is not measured
+    std::vector<uint8_t> operations;
+    std::vector<float> inputs;
+
+    // Keeps the compiler from optimizing the lookups away
+    volatile float sink;
+
+    // @return  The smallest measurable time between two clock reads in ns
+    static float clockOverheadNs();
+};
+
+TraceReplay::TraceReplay(const QueryTrace &_trace)
+{
+    operations.resize(_trace.count());
+    inputs.resize(_trace.count());
+
+    for (size_t i = 0; i < _trace.count(); i++)
+    {
+        QueryTrace::Query query = _trace.get(i);
+        operations[i] = query.operation;
+        inputs[i] = query.input;
+    }
+
+    sink = 0;
+}
+
+template <class Engine>
+TraceReplay::Result TraceReplay::run(Engine &_engine, int _repetitions)
+{
+    Result result;
+    size_t n = inputs.size();
+    float sum = 0;
+
+    // Throughput
+    PerfCounters counters;
+    counters.start();
+    Clock::time_point start = Clock::now();
+    for (int r = 0; r < _repetitions; r++)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            sum += (operations[i] == QueryTrace::X_TO_Y) ? _engine.xToy(inputs[i]) : _engine.yTox(inputs[i]);
+        }
+    }
+    Clock::time_point end = Clock::now();
+    counters.stop();
+
+    result.nQueries = n * _repetitions;
+    result.seconds = std::chrono::duration<double>(end - start).count();
+    result.queriesPerSecond = (result.seconds > 0) ? result.nQueries / result.seconds : 0;
+
+    for (int c = 0; c < PerfCounters::N_COUNTERS; c++)
+    {
+        PerfCounters::Counter counter = (PerfCounters::Counter)c;
+        if (counters.isAvailable(counter) && result.nQueries > 0)
+            result.perLookup[c] = (double)counters.read(counter) / result.nQueries;
+        else
+            result.perLookup[c] = -1;
+        result.scaled[c] = counters.isScaled(counter);
+    }
+
+    // Latency
+    float overhead = clockOverheadNs();
+    std::vector<float> latencies(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        Clock::time_point queryStart = Clock::now();
+        sum += (operations[i] == QueryTrace::X_TO_Y) ? _engine.xToy(inputs[i]) : _engine.yTox(inputs[i]);
+        Clock::time_point queryEnd = Clock::now();
+
+        float ns = std::chrono::duration<float, std::nano>(queryEnd - queryStart).count() - overhead;
+        latencies[i] = std::max(0.0f, ns);
+    }
+    sink = sum;
+
+    if (n == 0)
+    {
+        result.meanNs = result.medianNs = result.p99Ns = result.maxNs = 0;
+        return result;
+    }
+
+    double total = 0;
+    for (size_t i = 0; i < n; i++)
+        total += latencies[i];
+    result.meanNs = total / n;
+
+    std::sort(latencies.begin(), latencies.end());
+    result.medianNs = latencies[n / 2];
+    result.p99Ns = latencies[std::min(n - 1, n * 99 / 100)];
+    result.maxNs = latencies[n - 1];
+
+    return result;
+}
+
+void TraceReplay::print(const char *_name, const Result &_result)
+{
+    Printer::pc.printf("%s: %u queries in %.6f s, %.0f queries/s, latency mean %.1f ns, median %.1f ns, p99 %.1f ns, max %.1f ns\n",
+                       _name, (unsigned)_result.nQueries, _result.seconds, _result.queriesPerSecond,
+                       _result.meanNs, _result.medianNs, _result.p99Ns, _result.maxNs);
+
+    for (int c = 0; c < PerfCounters::N_COUNTERS; c++)
+    {
+        if (_result.perLookup[c] >= 0)
+            Printer::pc.printf("  %s/lookup: %.3f%s\n", PerfCounters::name((PerfCounters::Counter)c), _result.perLookup[c],
+                               _result.scaled[c] ? " (scaled)" : "");
+        else
+            Printer::pc.printf("  %s/lookup: n/a\n", PerfCounters::name((PerfCounters::Counter)c));
+    }
+}
+
+float TraceReplay::clockOverheadNs()
+{
+    float smallest = INFINITY;
+
+    for (int i = 0; i < 1000; i++)
+    {
+        Clock::time_point a = Clock::now();
+        Clock::time_point b = Clock::now();
+        smallest = std::min(smallest, std::chrono::duration<float, std::nano>(b - a).count());
+    }
+
+    return smallest;
+}
+
+#endif //TRACE_REPLAY_H
@@ -6,6 +6,22 @@
 // Contents: Simple test file.
 
 #include "FunctionToPiecewise.h"
+#include "PiecewiseLeastSquares.h"
+#include "OnlineCalibration.h"
+#include "DistanceStats.h"
+#include "RawThresholdEngine.h"
+#include "PiecewiseArithmetic.h"
+#include "PiecewiseTableStore.h"
+#include "NestedGridSampler.h"
+#include "Expression.h"
+#include "FoldedPiecewise.h"
+#include "LearnedIndexPiecewise.h"
+#include "StreamingPiecewiseFit.h"
+#include "ImplicitPiecewise.h"
+#include "SharedTableRegistry.h"
+#include "SensorSimulator.h"
+#include "PiecewiseEKF.h"
+#include "TraceReplay.h"
 #include "Printer.h"
 
 // Simple linear function with slope of 2
@@ -58,12 +74,893 @@ bool TestCase3()
    return false;
 }
 
+// Fits noisy samples of Func1 and checks the fit averages the noise out
+bool TestCase4()
+{
+   PiecewiseLeastSquares fitter(4, std::pair<float, float>(0, 5), PiecewiseLeastSquares::INCREASING);
+
+   for (int i = 0; i <= 1000; i++)
+   {
+      float x = i * 0.005f;
+      // Deterministic +-0.5 noise
+      float noise = (i % 2 == 0) ? 0.5f : -0.5f;
+      fitter.addSample(x, Func1(x) + noise);
+   }
+
+   FunctionToPiecewise piecewise = fitter.fit();
+   bool ok = piecewise.xToy(2.5) >= 4.95 && piecewise.xToy(2.5) <= 5.05;
+
+   // A V shape cannot be fitted increasing, the left half pools into a
+   // flat run that yTox() must still invert
+   PiecewiseLeastSquares pooledFitter(10, std::pair<float, float>(0, 5), PiecewiseLeastSquares::INCREASING);
+   for (int i = 0; i <= 1000; i++)
+   {
+      float x = i * 0.005f;
+      pooledFitter.addSample(x, fabs(x - 2.5f));
+   }
+
+   std::vector<FunctionToPiecewise::Point> knots = pooledFitter.fitKnots();
+   FunctionToPiecewise pooled(knots);
+   bool flat = false;
+   for (size_t k = 0; k < knots.size(); k++)
+   {
+      if (k > 0)
+      {
+         ok &= knots[k].y >= knots[k - 1].y;
+         flat |= knots[k].y == knots[k - 1].y;
+      }
+
+      float x = pooled.yTox(knots[k].y);
+      ok &= std::isfinite(x) && fabs(pooled.xToy(x) - knots[k].y) < 1e-4;
+   }
+   return ok && flat;
+}
+
+// Repeated references on a shifted Func1 pull the table towards them
+bool TestCase5()
+{
+   FunctionToPiecewise piecewise(Func1, 5, std::pair<float, float>(0, 5));
+   OnlineCalibration calibration(&piecewise);
+   const FunctionToPiecewise::LineFunc *segments = piecewise.getXSegments();
+
+   for (int i = 0; i < 50; i++)
+      calibration.update(2.5, Func1(2.5) + 1);
+
+   // An unshared table is updated in place, a shared one is copied once
+   bool inPlace = piecewise.getXSegments() == segments;
+   FunctionToPiecewise copy = piecewise;
+   calibration.update(2.5, Func1(2.5) + 1);
+   bool copied = piecewise.getXSegments() != copy.getXSegments() && copy.getXSegments() == segments;
+
+   if (piecewise.xToy(2.5) >= 5.95 && piecewise.xToy(2.5) <= 6.05 &&
+       piecewise.xToy(0.5) == 1 && inPlace && copied)
+      return true;
+   return false;
+}
+
+// Reduces a log of flux readings to distance statistics
+bool TestCase6()
+{
+   FunctionToPiecewise piecewise(Func2, 100, std::pair<float, float>(0, 16));
+
+   float flux[100];
+   for (int i = 0; i < 100; i++)
+      flux[i] = Func2(2 + i * 0.08f);
+
+   MinMaxMeanReducer stats;
+   TimeAboveThresholdReducer above(6, 0.001);
+   CombinedReducer<MinMaxMeanReducer, TimeAboveThresholdReducer> both(stats, above);
+   piecewise.yToxReduce(flux, 100, both);
+
+   // The distances 2..9.92 spread over 4 bins of 2 mm
+   HistogramReducer histogram(4, std::pair<float, float>(2, 10));
+   piecewise.yToxReduce(flux, 100, histogram);
+   const std::vector<size_t> &bins = histogram.getBins();
+   bool binsOk = bins[0] + bins[1] + bins[2] + bins[3] == 100 &&
+                 bins[0] >= 24 && bins[0] <= 26 && bins[3] >= 24 && bins[3] <= 26;
+
+   // Out of range, infinite and NaN values land in the end bins
+   HistogramReducer edges(4, std::pair<float, float>(2, 10));
+   edges.add(-1e30f);
+   edges.add(-INFINITY);
+   edges.add(NAN);
+   edges.add(1e30f);
+   edges.add(INFINITY);
+   edges.add(10);
+   binsOk &= edges.getBins()[0] == 3 && edges.getBins()[3] == 3;
+
+   if (stats.min() >= 1.95 && stats.min() <= 2.05 &&
+       stats.max() >= 9.87 && stats.max() <= 9.97 &&
+       stats.mean() >= 5.91 && stats.mean() <= 6.01 &&
+       above.crossings() == 1 && binsOk)
+      return true;
+   return false;
+}
+
+// Maps a flux window back to the distance window it came from
+bool TestCase7()
+{
+   FunctionToPiecewise piecewise(Func2, 100, std::pair<float, float>(0, 16));
+
+   std::vector<std::pair<float, float>> window =
+       piecewise.yIntervalTox(std::pair<float, float>(Func2(3), Func2(2)));
+
+   if (window.size() == 1 &&
+       window[0].first >= 1.99 && window[0].first <= 2.01 &&
+       window[0].second >= 2.99 && window[0].second <= 3.01)
+      return true;
+   return false;
+}
+
+// Presses and releases a key by feeding flux readings, not distances
+bool TestCase8()
+{
+   FunctionToPiecewise piecewise(Func2, 100, std::pair<float, float>(0, 16));
+   RawThresholdEngine engine(&piecewise);
+   engine.addChannel(2, 2.5);
+   engine.addChannel(1, 1.5);
+
+   RawThresholdEngine::Event events[2];
+   float raw[2];
+
+   // Both magnets at 1.8: only channel 0 actuates
+   raw[0] = raw[1] = Func2(1.8);
+   int nPressed = engine.process(raw, events);
+   bool pressedOk = nPressed == 1 && events[0].channel == 0 && events[0].actuated;
+
+   // 2.2 is inside the hysteresis, nothing happens
+   raw[0] = raw[1] = Func2(2.2);
+   int nHeld = engine.process(raw, events);
+
+   raw[0] = raw[1] = Func2(3);
+   int nReleased = engine.process(raw, events);
+   bool releasedOk = nReleased == 1 && events[0].channel == 0 && !events[0].actuated;
+
+   // Without hysteresis on a rising table, a far magnet must not actuate
+   FunctionToPiecewise rising(Func1, 1, std::pair<float, float>(0, 16));
+   RawThresholdEngine risingEngine(&rising);
+   risingEngine.addChannel(5, 5);
+   raw[0] = Func1(9);
+   int nFar = risingEngine.process(raw, events);
+   raw[0] = Func1(4);
+   int nNear = risingEngine.process(raw, events);
+
+   // A release at the end of the interval is valid, and setting up the
+   // thresholds does not show up in a trace of the real queries
+   QueryTrace trace(4);
+   piecewise.setTrace(&trace);
+   RawThresholdEngine farEngine(&piecewise);
+   farEngine.addChannel(15, 16);
+   piecewise.setTrace(nullptr);
+   raw[0] = Func2(14);
+   int nFarPressed = farEngine.process(raw, events);
+
+   if (pressedOk && nHeld == 0 && releasedOk && nFar == 0 && nNear == 1 && events[0].actuated &&
+       trace.count() == 0 && nFarPressed == 1)
+      return true;
+   return false;
+}
+
+// Superposes and multiplies two tables
+bool TestCase9()
+{
+   FunctionToPiecewise line(Func1, 1, std::pair<float, float>(0, 5));
+   FunctionToPiecewise field(Func2, 100, std::pair<float, float>(0, 16));
+
+   FunctionToPiecewise sum = PiecewiseArithmetic::add(line, field);
+   FunctionToPiecewise square = PiecewiseArithmetic::multiply(line, line, 0.01);
+   FunctionToPiecewise lower = PiecewiseArithmetic::min(line, PiecewiseArithmetic::affine(line, -1, 5));
+
+   if (sum.getKnots().back().x == 5 &&
+       fabs(sum.xToy(3) - (6 + field.xToy(3))) < 0.001 &&
+       fabs(square.xToy(1.5) - 9) <= 0.01 &&
+       fabs(lower.xToy(1) - 2) < 0.001 && fabs(lower.xToy(4) + 3) < 0.001)
+      return true;
+   return false;
+}
+
+// Func2 with the magnet's remanence _params[0] as a parameter
+float Func2Remanence(float _d, const float *_params)
+{
+   return Func2(_d) * (_params[0] / 1320);
+}
+
+// Builds tables for three magnets of different strength in one store
+bool TestCase10()
+{
+   PiecewiseTableStore store(100, std::pair<float, float>(0, 16));
+   float remanence[3] = {1320, 660, 1000};
+   PiecewiseTableStore::Handle first = store.buildFromParameters(Func2Remanence, remanence, 1, 3);
+
+   if (store.size() == 3 &&
+       store.xToy(first, 14) >= 12.27 && store.xToy(first, 14) <= 12.275 &&
+       store.xToy(first + 1, 14) >= 6.135 && store.xToy(first + 1, 14) <= 6.1375 &&
+       store.yTox(first + 1, 6.1365) >= 13.9 && store.yTox(first + 1, 6.1365) <= 14.1)
+      return true;
+   return false;
+}
+
+// Sweeps 25 to 200 segments with as many samples as the finest build
+bool TestCase11()
+{
+   NestedGridSampler sampler(Func2, 25, std::pair<float, float>(0, 16), 3);
+
+   for (int level = 0; level <= 3; level++)
+      sampler.build(level);
+
+   FunctionToPiecewise finest = sampler.build(3);
+
+   if (sampler.getEvaluations() == 201 &&
+       finest.xToy(14) >= 12.27 && finest.xToy(14) <= 12.275)
+      return true;
+   return false;
+}
+
+// Copies share the table until one of them is changed
+bool TestCase12()
+{
+   FunctionToPiecewise piecewise(Func2, 100, std::pair<float, float>(0, 16));
+   FunctionToPiecewise copy = piecewise;
+   bool shared = &copy.getKnots() == &piecewise.getKnots();
+
+   copy.setKnotY(0, 0);
+
+   if (shared && &copy.getKnots() != &piecewise.getKnots() &&
+       piecewise.getKnots()[0].y == Func2(0) && copy.getKnots()[0].y == 0)
+      return true;
+   return false;
+}
+
+// Func2 written as text gives the same table as the compiled Func2
+bool TestCase13()
+{
+   std::map<std::string, float> magnet;
+   magnet["l"] = 19.05;
+   magnet["w"] = 9.525;
+   magnet["t"] = 1.5875;
+   magnet["br"] = 1320;
+
+   Expression func2("(br / pi) * (atan(w*l / (2*x*sqrt(4*x^2 + w^2 + l^2)))"
+                    " - atan(w*l / (2*(x+t)*sqrt(4*(x+t)^2 + w^2 + l^2))))",
+                    magnet);
+   FunctionToPiecewise piecewise = func2.tabulate(100, std::pair<float, float>(0, 16));
+
+   func2.setParameter("br", 660);
+
+   // Deep expressions run fewer inputs per pass, the batch must still
+   // match one evaluation at a time
+   float xs[150];
+   float ys[150];
+   for (int i = 0; i < 150; i++)
+      xs[i] = 0.5f + i * 0.1f;
+   func2.evalBatch(xs, ys, 150);
+   bool same = true;
+   for (int i = 0; i < 150; i++)
+      same &= ys[i] == func2.eval(xs[i]);
+
+   if (piecewise.xToy(14) >= 12.27 && piecewise.xToy(14) <= 12.275 &&
+       fabs(func2.eval(5) - Func2(5) / 2) < 0.01 &&
+       Expression("-2^2 + pow(3, 2) * abs(-1)").eval(0) == 5 &&
+       Expression("1.5e3 + .25 + 2.5E-1 + 0.000001e+6").eval(0) == 1501.5f &&
+       Expression("2*e").eval(0) == (float)(2 * M_E) && same)
+      return true;
+   return false;
+}
+
+// Records queries until the trace is full
+bool TestCase14()
+{
+   FunctionToPiecewise piecewise(Func2, 100, std::pair<float, float>(0, 16));
+   QueryTrace trace(2);
+   piecewise.setTrace(&trace);
+
+   piecewise.xToy(14);
+   piecewise.yTox(12.273);
+   piecewise.xToy(1);
+   piecewise.setTrace(nullptr);
+   piecewise.xToy(2);
+
+   if (trace.count() == 2 && trace.dropped() == 1 &&
+       trace.get(0).operation == QueryTrace::X_TO_Y && trace.get(0).input == 14 &&
+       trace.get(1).operation == QueryTrace::Y_TO_X && trace.get(1).input == 12.273f)
+      return true;
+   return false;
+}
+
+// The batch lookups give the same results as the single lookups
+bool TestCase15()
+{
+   FunctionToPiecewise piecewise(Func2, 1000, std::pair<float, float>(0.5, 16));
+
+   float x[50], y[50], batchY[50], batchX[50];
+   for (int i = 0; i < 50; i++)
+      x[i] = 0.5f + (i * 37 % 50) * 0.3f;
+
+   piecewise.xToyBatch(x, batchY, 50);
+   for (int i = 0; i < 50; i++)
+      y[i] = piecewise.xToy(x[i]);
+   piecewise.yToxBatch(y, batchX, 50);
+
+   for (int i = 0; i < 50; i++)
+   {
+      if (fabs(batchY[i] - y[i]) > 0.0001f || fabs(batchX[i] - x[i]) > 0.01f)
+         return false;
+   }
+   return true;
+}
+
+// Small tables stay on the heap even if huge pages are preferred
+bool TestCase16()
+{
+   SegmentMemory::setPolicy(SegmentMemory::TRANSPARENT_HUGE_PAGES);
+   FunctionToPiecewise piecewise(Func2, 100, std::pair<float, float>(0, 16));
+   SegmentMemory::setPolicy(SegmentMemory::HEAP);
+
+   FunctionToPiecewise::Footprint footprint = piecewise.getFootprint();
+   size_t nKnots = piecewise.getKnots().size();
+
+   if (footprint.knotXsBacking == SegmentMemory::HEAP && footprint.knotYsBacking == SegmentMemory::HEAP &&
+       footprint.xSegmentsBacking == SegmentMemory::HEAP && footprint.ySegmentsBacking == SegmentMemory::HEAP &&
+       footprint.xErrorsBacking == SegmentMemory::HEAP && footprint.yErrorsBacking == SegmentMemory::HEAP &&
+       footprint.segmentBytes == 2 * nKnots * sizeof(float) + 2 * (nKnots - 1) * sizeof(FunctionToPiecewise::LineFunc) &&
+       footprint.errorBytes == 2 * (nKnots - 1) * sizeof(float))
+      return true;
+   return false;
+}
+
+float Plateau(float _x)
+{
+   return std::min(_x, 8.0f);
+}
+
+// The returned error bounds hold against the original function
+bool TestCase17()
+{
+   FunctionToPiecewise piecewise(Func2, 100, std::pair<float, float>(0.5, 16));
+   piecewise.computeErrorBounds();
+
+   bool ok = true;
+   for (float d = 0.6; d < 15.9; d += 0.37)
+   {
+      float yBound, xBound;
+      float y = piecewise.xToyWithError(d, yBound);
+      float x = piecewise.yToxWithError(Func2(d), xBound);
+
+      ok &= fabs(y - Func2(d)) <= yBound * 1.01f + 1e-4f;
+      ok &= fabs(x - d) <= xBound * 1.01f + 1e-4f;
+      ok &= yBound < 1 && xBound < 0.1;
+   }
+
+   // A flat segment has no inverse, yTox() must still return an x that
+   // maps to the queried y
+   FunctionToPiecewise plateau(Plateau, 16, std::pair<float, float>(0, 16));
+   plateau.computeErrorBounds();
+
+   float xBound;
+   float x = plateau.yToxWithError(8, xBound);
+   ok &= std::isfinite(x) && std::isfinite(xBound) && Plateau(x) == 8;
+   ok &= plateau.yTox(8) == x;
+
+   float y = 8;
+   float xBatch;
+   plateau.yToxBatch(&y, &xBatch, 1);
+   ok &= xBatch == x;
+   return ok;
+}
+
+float Cos(float _x)
+{
+   return cos(_x);
+}
+
+float Cube(float _x)
+{
+   return _x * _x * _x;
+}
+
+// Periodic/even and odd functions only tabulate part of their interval
+bool TestCase18()
+{
+   FoldedPiecewise angular(Cos, 200, std::pair<float, float>(0, 2 * M_PI), FoldedPiecewise::EVEN, M_PI, 2 * M_PI);
+   FoldedPiecewise cube(Cube, 200, std::pair<float, float>(-2, 2), FoldedPiecewise::ODD, 0);
+
+   float x[2] = {-1.5, 1.5};
+   float y[2];
+   cube.xToyBatch(x, y, 2);
+
+   if (fabs(angular.xToy(7) - cos(7)) < 0.001 &&
+       fabs(angular.xToy(-1) - cos(-1)) < 0.001 &&
+       angular.getFundamental().getKnots().front().x == (float)M_PI &&
+       fabs(y[0] + 3.375) < 0.01 && fabs(y[1] - 3.375) < 0.01 &&
+       fabs(cube.yTox(-3.375) + 1.5) < 0.01)
+      return true;
+   return false;
+}
+
+// Knots that get denser towards the magnet are found with a small window
+bool TestCase19()
+{
+   std::vector<FunctionToPiecewise::Point> knots(1001);
+   for (int i = 0; i <= 1000; i++)
+   {
+      float t = i / 1000.0f;
+      knots[i].x = 0.5f + 15.5f * t * t;
+      knots[i].y = Func2(knots[i].x);
+   }
+   knots[1000].x = 16;
+
+   FunctionToPiecewise piecewise(knots);
+   LearnedIndexPiecewise learned(piecewise);
+
+   bool ok = learned.getMaxWindow() < 32;
+   for (float d = 0.5; d <= 16; d += 0.0137)
+   {
+      float y;
+      piecewise.xToyBatch(&d, &y, 1);
+      ok &= learned.xToy(d) == y;
+      ok &= fabs(learned.xToy(d) - Func2(d)) < 1e-4 * fabs(Func2(d));
+      ok &= fabs(learned.yTox(y) - d) < 0.001;
+   }
+   return ok;
+}
+
+// Every kernel variant the CPU supports returns exactly what the generic one does
+bool TestCase20()
+{
+   FunctionToPiecewise piecewise(Func2, 500, std::pair<float, float>(0.5, 16));
+   KernelVariant variants[] = {KERNEL_GENERIC, KERNEL_SSE42, KERNEL_AVX2, KERNEL_AVX512};
+   float x[100], expected[100], y[100];
+   bool ok = true;
+
+   for (int i = 0; i < 100; i++)
+      x[i] = 0.5 + 15.5 * i / 99;
+
+   KernelDispatch<FunctionToPiecewise::LineFunc>::select(KERNEL_GENERIC);
+   piecewise.xToyBatch(x, expected, 100);
+
+   for (int v = 0; v < 4; v++)
+   {
+      if (!KernelDispatch<FunctionToPiecewise::LineFunc>::isSupported(variants[v]))
+         continue;
+
+      KernelDispatch<FunctionToPiecewise::LineFunc>::select(variants[v]);
+      ok &= KernelDispatch<FunctionToPiecewise::LineFunc>::selected() == variants[v];
+
+      FunctionToPiecewise rebuilt(piecewise.getKnots());
+      rebuilt.xToyBatch(x, y, 100);
+      for (int i = 0; i < 100; i++)
+         ok &= y[i] == expected[i];
+   }
+
+   KernelDispatch<FunctionToPiecewise::LineFunc>::select(KERNEL_AUTO);
+   return ok;
+}
+
+// Fitting from bin statistics gives the same table as fitting the samples
+bool TestCase21()
+{
+   StreamingPiecewiseFit streaming(400, std::pair<float, float>(0.5, 16));
+   PiecewiseLeastSquares direct(50, std::pair<float, float>(0.5, 16));
+   float x[1000], y[1000];
+
+   // The same samples as interleaved float pairs for read()
+   FILE *file = tmpfile();
+   if (file == nullptr)
+      return false;
+
+   srand(7);
+   for (int chunk = 0; chunk < 100; chunk++)
+   {
+      for (int i = 0; i < 1000; i++)
+      {
+         x[i] = 0.5 + 15.5 * ((float)rand() / RAND_MAX);
+         y[i] = Func2(x[i]) + 0.01 * ((float)rand() / RAND_MAX - 0.5);
+      }
+      streaming.addSamples(x, y, 1000);
+      direct.addSamples(x, y, 1000);
+      for (int i = 0; i < 1000; i++)
+      {
+         float pair[2] = {x[i], y[i]};
+         fwrite(pair, sizeof(float), 2, file);
+      }
+   }
+
+   std::vector<FunctionToPiecewise::Point> a = streaming.fitKnots(50);
+   std::vector<FunctionToPiecewise::Point> b = direct.fitKnots();
+
+   // Reading the file in chunks that do not divide it gives the same fit
+   StreamingPiecewiseFit fromFile(400, std::pair<float, float>(0.5, 16));
+   rewind(file);
+   size_t nRead = fromFile.read(file, 300);
+   fclose(file);
+   std::vector<FunctionToPiecewise::Point> c = fromFile.fitKnots(50);
+
+   bool ok = streaming.getSampleCount() == 100000 && a.size() == b.size();
+   ok &= nRead == 100000 && c.size() == a.size();
+   for (size_t k = 0; ok && k < a.size(); k++)
+      ok &= c[k].x == a[k].x && c[k].y == a[k].y;
+   for (size_t k = 0; ok && k < a.size(); k++)
+      ok &= fabs(a[k].x - b[k].x) < 1e-5 && fabs(a[k].y - b[k].y) < 1e-4 * fabs(b[k].y) + 1e-4;
+
+   // Any divisor of the number of bins can be fitted from the same pass
+   FunctionToPiecewise coarse = streaming.fit(80, PiecewiseLeastSquares::DECREASING);
+   ok &= coarse.getKnots().size() == 81 && fabs(coarse.xToy(8) - Func2(8)) < 0.001 * Func2(8);
+   return ok;
+}
+
+// y is only given implicitly: y^3 + y - x = 0
+float CubicRelation(float _x, float _y)
+{
+   return _y * _y * _y + _y - _x;
+}
+
+// The traced curve is the root of the relation at every x
+bool TestCase22()
+{
+   ImplicitPiecewise implicit(CubicRelation, 200, std::pair<float, float>(0, 10), 0);
+   FunctionToPiecewise piecewise = implicit.build();
+
+   bool ok = true;
+   for (float y = 0; y <= 2; y += 0.05)
+   {
+      float x = y * y * y + y;
+      ok &= fabs(piecewise.xToy(x) - y) < 0.002;
+      ok &= fabs(piecewise.yTox(y) - x) < 0.01;
+   }
+   return ok;
+}
+
+// A unit's gain/offset errors are corrected with 16 bytes on a shared table
+bool TestCase23()
+{
+   FunctionToPiecewise master(Func2, 400, std::pair<float, float>(0.5, 16));
+   float x[2] = {2, 6};
+   float masterY[2], measuredY[2], masterX[2];
+
+   // Output error: the unit reads 1.1 * B + 3
+   master.xToyBatch(x, masterY, 2);
+   for (int i = 0; i < 2; i++)
+      measuredY[i] = 1.1 * Func2(x[i]) + 3;
+   AffineCorrection output = AffineCorrection::fitOutput(masterY, measuredY, 2);
+
+   // Input error: the unit's magnet sits 0.3 further away
+   for (int i = 0; i < 2; i++)
+      measuredY[i] = Func2(x[i] + 0.3);
+   master.yToxBatch(measuredY, masterX, 2);
+   AffineCorrection input = AffineCorrection::fitInput(x, masterX, 2);
+
+   float d = 4, y, back;
+   bool ok = sizeof(AffineCorrection) == 16;
+
+   master.xToyBatch(&d, &y, 1, output);
+   master.yToxBatch(&y, &back, 1, output);
+   ok &= fabs(y - (1.1 * Func2(4) + 3)) < 0.001 * y && fabs(back - 4) < 0.01;
+
+   master.xToyBatch(&d, &y, 1, input);
+   master.yToxBatch(&y, &back, 1, input);
+   ok &= fabs(y - Func2(4.3)) < 0.001 * y && fabs(back - 4) < 0.01;
+   return ok;
+}
+
+// Acquisition frame with the flux and the distance it is converted to
+typedef struct
+{
+   uint32_t timestamp;
+   uint16_t channel;
+   uint16_t status;
+   float flux;
+   float distance;
+} Frame;
+
+// Distances are written straight into the frames the flux is read from
+bool TestCase24()
+{
+   FunctionToPiecewise piecewise(Func2, 400, std::pair<float, float>(0.5, 16));
+   Frame frames[50];
+   float distances[50], flux[50];
+
+   for (int i = 0; i < 50; i++)
+   {
+      distances[i] = 1 + 0.25 * i;
+      frames[i].timestamp = i;
+      frames[i].status = 0xBEEF;
+   }
+   piecewise.xToyBatch(distances, flux, 50);
+   for (int i = 0; i < 50; i++)
+      frames[i].flux = flux[i];
+
+   piecewise.yToxBatch(ConstStridedView::field(frames, &Frame::flux), StridedView::field(frames, &Frame::distance), 50);
+
+   bool ok = true;
+   for (int i = 0; i < 50; i++)
+   {
+      float expected;
+      piecewise.yToxBatch(&flux[i], &expected, 1);
+      ok &= frames[i].distance == expected && frames[i].flux == flux[i];
+      ok &= frames[i].timestamp == (uint32_t)i && frames[i].status == 0xBEEF;
+   }
+   return ok;
+}
+
+// Published tables are queried in place and replaced atomically
+bool TestCase25()
+{
+#if defined(__linux__)
+   FunctionToPiecewise first(Func2, 300, std::pair<float, float>(0.5, 16));
+   FunctionToPiecewise second(Func1, 10, std::pair<float, float>(0.5, 16));
+   SharedTable shared;
+   float x = 3, y, expected, back;
+
+   SharedTableRegistry::remove("FunctionToPiecewiseTest");
+   bool ok = !shared.attach("FunctionToPiecewiseTest");
+
+   uint64_t version = SharedTableRegistry::publish("FunctionToPiecewiseTest", first);
+   ok &= shared.attach("FunctionToPiecewiseTest") && shared.getVersion() == version && !shared.isStale();
+
+   shared.xToyBatch(&x, &y, 1);
+   first.xToyBatch(&x, &expected, 1);
+   shared.yToxBatch(&y, &back, 1);
+   ok &= y == expected && fabs(back - 3) < 0.001;
+
+   // The attached version stays usable after it is replaced
+   SharedTableRegistry::publish("FunctionToPiecewiseTest", second);
+   shared.xToyBatch(&x, &y, 1);
+   ok &= shared.isStale() && y == expected;
+
+   ok &= shared.attach("FunctionToPiecewiseTest") && shared.getSegmentCount() == second.getKnots().size() - 1;
+   shared.xToyBatch(&x, &y, 1);
+   ok &= fabs(y - 6) < 0.001;
+
+   // A version orphaned by a crashed publisher is swept too
+   int orphan = shm_open("/FunctionToPiecewiseTest.v77", O_RDWR | O_CREAT, 0644);
+   ok &= orphan >= 0;
+   close(orphan);
+
+   shared.detach();
+   SharedTableRegistry::remove("FunctionToPiecewiseTest");
+   ok &= shm_open("/FunctionToPiecewiseTest.v77", O_RDONLY, 0) < 0;
+   ok &= !shared.attach("FunctionToPiecewiseTest");
+
+   // A current version with an unknown format is refused
+   int controlFd = shm_open("/FunctionToPiecewiseTest", O_RDWR | O_CREAT, 0644);
+   int tableFd = shm_open("/FunctionToPiecewiseTest.v1", O_RDWR | O_CREAT, 0644);
+   uint64_t control[2] = {1, 1};
+   ok &= controlFd >= 0 && tableFd >= 0 && write(controlFd, control, sizeof(control)) == sizeof(control) &&
+         ftruncate(tableFd, 256) == 0;
+   close(controlFd);
+   close(tableFd);
+   ok &= !shared.attach("FunctionToPiecewiseTest") && !shared.isAttached();
+
+   // So is a well formed header with a direction that is not -1, 0 or 1
+   struct
+   {
+      char magic[4];
+      uint32_t format;
+      uint64_t version;
+      uint64_t nSegments;
+      float ySign;
+      uint32_t reserved;
+      float knots[4];
+      float segments[4];
+   } corrupt = {{'F', 'T', 'P', 'S'}, 1, 1, 1, 0.5, 0, {0}, {0}};
+   tableFd = shm_open("/FunctionToPiecewiseTest.v1", O_RDWR, 0);
+   ok &= tableFd >= 0 && ftruncate(tableFd, sizeof(corrupt)) == 0 && write(tableFd, &corrupt, sizeof(corrupt)) == sizeof(corrupt);
+   close(tableFd);
+   ok &= !shared.attach("FunctionToPiecewiseTest");
+   corrupt.ySign = 1;
+   tableFd = shm_open("/FunctionToPiecewiseTest.v1", O_RDWR, 0);
+   ok &= tableFd >= 0 && write(tableFd, &corrupt, sizeof(corrupt)) == sizeof(corrupt);
+   close(tableFd);
+   ok &= shared.attach("FunctionToPiecewiseTest");
+   shared.detach();
+
+   SharedTableRegistry::remove("FunctionToPiecewiseTest");
+   return ok;
+#else
+   return true;
+#endif
+}
+
+// A simulated key press stream converts back to the magnet positions
+bool TestCase26()
+{
+   // Small enough for the MCU: a coarse table and the stream in blocks
+   FunctionToPiecewise piecewise(Func2, 100, std::pair<float, float>(0.5, 16));
+   SensorSimulator simulator(Func2, 1000, 3);
+   SensorSimulator same(Func2, 1000, 3);
+   float raw[50], positions[50], distances[50];
+
+   simulator.setKeyPress(8, 1, 0.05, 0.1, 0.25);
+   simulator.setNoise(0.01);
+   simulator.setAdc(16, 1000);
+   same.setKeyPress(8, 1, 0.05, 0.1, 0.25);
+   same.setNoise(0.01);
+   same.setAdc(16, 1000);
+
+   bool ok = true;
+   for (int block = 0; block < 10; block++)
+   {
+      simulator.generate(raw, 50, positions);
+      piecewise.yToxBatch(raw, distances, 50);
+
+      for (int i = 0; i < 50; i++)
+      {
+         float again;
+         same.generate(&again, 1);
+         ok &= fabs(distances[i] - positions[i]) < 0.05 && raw[i] == again;
+      }
+   }
+   return ok && simulator.getTime() == 0.5;
+}
+
+// The filter tracks noisy channels better than inverting every reading
+bool TestCase27()
+{
+   FunctionToPiecewise piecewise(Func2, 400, std::pair<float, float>(0.5, 16));
+   const int N_CHANNELS = 4;
+   std::vector<SensorSimulator> simulators;
+   PiecewiseEKF filter(piecewise, N_CHANNELS, 1e4, 1.0);
+
+   for (int c = 0; c < N_CHANNELS; c++)
+   {
+      simulators.push_back(SensorSimulator(Func2, 1000, c + 1));
+      simulators[c].setOscillation(4 + c, 1.5, 2 + c);
+      simulators[c].setNoise(1.0);
+      filter.reset(c, 4 + c, 1, 100);
+   }
+
+   double rawError = 0, filterError = 0;
+   for (int k = 0; k < 2000; k++)
+   {
+      float readings[N_CHANNELS], positions[N_CHANNELS], inverted[N_CHANNELS];
+      for (int c = 0; c < N_CHANNELS; c++)
+         simulators[c].generate(&readings[c], 1, &positions[c]);
+
+      filter.update(readings, 0.001);
+      piecewise.yToxBatch(readings, inverted, N_CHANNELS);
+
+      // After the filter settled
+      for (int c = 0; k > 200 && c < N_CHANNELS; c++)
+      {
+         rawError += pow(inverted[c] - positions[c], 2);
+         filterError += pow(filter.getPositions()[c] - positions[c], 2);
+      }
+   }
+
+   float slope;
+   piecewise.xToyWithSlope(4, slope);
+   bool ok = filterError < 0.5 * rawError && fabs(slope - (Func2(4.01) - Func2(3.99)) / 0.02) < 0.1;
+
+   // The batch kernel returns the same values and slopes
+   float x[40], y[40], slopes[40];
+   for (int i = 0; i < 40; i++)
+      x[i] = 0.5 + 15.5 * i / 39;
+   piecewise.xToyBatchWithSlope(x, y, slopes, 40);
+   for (int i = 0; i < 40; i++)
+      ok &= y[i] == piecewise.xToyWithSlope(x[i], slope) && slopes[i] == slope;
+   return ok;
+}
+
+// Unavailable counters read as 0 and are never reported as scaled
+bool TestCase28()
+{
+   PerfCounters counters;
+   counters.start();
+   volatile float sum = 0;
+   for (int i = 0; i < 1000; i++)
+      sum += Func1(i);
+   counters.stop();
+
+   for (int c = 0; c < PerfCounters::N_COUNTERS; c++)
+   {
+      PerfCounters::Counter counter = (PerfCounters::Counter)c;
+      if (!counters.isAvailable(counter) && (counters.read(counter) != 0 || counters.isScaled(counter)))
+         return false;
+   }
+   return true;
+}
+
+// Engine for TraceReplay that logs its queries, yTox() inputs negated
+struct ReplayLog
+{
+   std::vector<float> queries;
+
+   float xToy(float _x)
+   {
+      queries.push_back(_x);
+      return _x;
+   }
+
+   float yTox(float _y)
+   {
+      queries.push_back(-_y);
+      return _y;
+   }
+};
+
+// Records a mixed trace, saves and reloads it and replays it
+bool TestCase29()
+{
+   FunctionToPiecewise piecewise(Func1, 10, std::pair<float, float>(0, 5));
+   QueryTrace trace(16);
+   piecewise.setTrace(&trace);
+   piecewise.xToy(1);
+   piecewise.yTox(4);
+   piecewise.xToy(2.5);
+   piecewise.setTrace(nullptr);
+   piecewise.yTox(6);
+
+   FILE *file = tmpfile();
+   if (file == nullptr || !trace.save(file))
+      return false;
+   rewind(file);
+   QueryTrace loaded(1);
+   bool loadedOk = loaded.load(file);
+
+   // The first record is xToy(1), 1.0f is 0x3F800000 little-endian
+   uint8_t bytes[17];
+   rewind(file);
+   loadedOk &= fread(bytes, 1, sizeof(bytes), file) == sizeof(bytes) &&
+               bytes[4] == 1 && bytes[8] == 3 && bytes[12] == 0 &&
+               bytes[13] == 0x00 && bytes[14] == 0x00 && bytes[15] == 0x80 && bytes[16] == 0x3F;
+
+   // An unknown operation is rejected
+   uint8_t badOperation = 2;
+   fseek(file, 12, SEEK_SET);
+   fwrite(&badOperation, 1, 1, file);
+   rewind(file);
+   QueryTrace rejected(1);
+   loadedOk &= !rejected.load(file) && rejected.count() == 0;
+   fclose(file);
+
+   if (!loadedOk || loaded.count() != 3 ||
+       loaded.get(0).operation != QueryTrace::X_TO_Y || loaded.get(0).input != 1 ||
+       loaded.get(1).operation != QueryTrace::Y_TO_X || loaded.get(1).input != 4 ||
+       loaded.get(2).operation != QueryTrace::X_TO_Y || loaded.get(2).input != 2.5)
+      return false;
+
+   // The throughput pass replays the trace twice, the latency pass once
+   TraceReplay replay(loaded);
+   ReplayLog log;
+   TraceReplay::Result result = replay.run(log, 2);
+   std::vector<float> expected = {1, -4, 2.5, 1, -4, 2.5, 1, -4, 2.5};
+   if (result.nQueries == 6 && log.queries == expected)
+      return true;
+   return false;
+}
+
 int main(int argc, char *argv[])
 {
    wait(5);
    Printer::pc.printf("TestCase1 returned: %d\n", TestCase1());
    Printer::pc.printf("TestCase2 returned: %d\n", TestCase2());
    Printer::pc.printf("TestCase3 returned: %d\n", TestCase3());
+   Printer::pc.printf("TestCase4 returned: %d\n", TestCase4());
+   Printer::pc.printf("TestCase5 returned: %d\n", TestCase5());
+   Printer::pc.printf("TestCase6 returned: %d\n", TestCase6());
+   Printer::pc.printf("TestCase7 returned: %d\n", TestCase7());
+   Printer::pc.printf("TestCase8 returned: %d\n", TestCase8());
+   Printer::pc.printf("TestCase9 returned: %d\n", TestCase9());
+   Printer::pc.printf("TestCase10 returned: %d\n", TestCase10());
+   Printer::pc.printf("TestCase11 returned: %d\n", TestCase11());
+   Printer::pc.printf("TestCase12 returned: %d\n", TestCase12());
+   Printer::pc.printf("TestCase13 returned: %d\n", TestCase13());
+   Printer::pc.printf("TestCase14 returned: %d\n", TestCase14());
+   Printer::pc.printf("TestCase15 returned: %d\n", TestCase15());
+   Printer::pc.printf("TestCase16 returned: %d\n", TestCase16());
+   Printer::pc.printf("TestCase17 returned: %d\n", TestCase17());
+   Printer::pc.printf("TestCase18 returned: %d\n", TestCase18());
+   Printer::pc.printf("TestCase19 returned: %d\n", TestCase19());
+   Printer::pc.printf("TestCase20 returned: %d\n", TestCase20());
+   Printer::pc.printf("TestCase21 returned: %d\n", TestCase21());
+   Printer::pc.printf("TestCase22 returned: %d\n", TestCase22());
+   Printer::pc.printf("TestCase23 returned: %d\n", TestCase23());
+   Printer::pc.printf("TestCase24 returned: %d\n", TestCase24());
+   Printer::pc.printf("TestCase25 returned: %d\n", TestCase25());
+   Printer::pc.printf("TestCase26 returned: %d\n", TestCase26());
+   Printer::pc.printf("TestCase27 returned: %d\n", TestCase27());
+   Printer::pc.printf("TestCase28 returned: %d\n", TestCase28());
+   Printer::pc.printf("TestCase29 returned: %d\n", TestCase29());
 
    Printer::pc.printf("Testing complete");
 }
\ No newline at end of file